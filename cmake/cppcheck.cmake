@@ -8,7 +8,7 @@ function(AttachCppCheck)
                 "--inconclusive"
                 "-I ./include"
                 "--force" 
-                "--std=c++17"
+                "--std=c++20"
         )
     endif()
 endfunction()
\ No newline at end of file
@@ -1,13 +1,19 @@
 #pragma once
 #include <optional>
+#include <span>
 #include <tuple>
 
 #include "camera.hpp"
+#include "debug_view.hpp"
 #include "image.hpp"
+#include "job_system.hpp"
 #include "line.hpp"
 #include "math.hpp"
+#include "pipeline_stats.hpp"
+#include "scanline.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
+#include "trace.hpp"
 
 class Viewport {
    public:
@@ -19,6 +25,13 @@ class Viewport {
 
 enum FaceCull { Front, Back, None };
 
+// 顶点处理每个任务至少处理的顶点数，少于这个数的mesh直接在当前线程处理
+constexpr size_t VERTEX_JOB_GRAIN = 2048;
+
+// 光栅化按这个行数切成水平的块并行处理，每块只写自己的行
+// 和懒清屏的块对齐，不同任务不会同时填充同一个清屏块
+constexpr uint32_t RASTER_TILE_ROWS = CLEAR_TILE_SIZE;
+
 enum FrontFace { CW, CCW };
 
 class IRenderer {
@@ -29,9 +42,10 @@ class IRenderer {
     virtual void ClearDepth() = 0;
     virtual uint32_t GetCanvaWidth() = 0;
     virtual uint32_t GetCanvaHeight() = 0;
-    virtual void DrawTriangle(Mat44 &model, std::vector<Vertex> &vertices,
-                              TextureStorage &texture_storage) = 0;
-    virtual std::vector<uint8_t> GetRenderedImage() = 0;
+    virtual void DrawTriangle(Mat44 &model, std::span<const Vertex> vertices,
+                              const TextureStorage &texture_storage) = 0;
+    // 像素格式为FRAMEBUFFER_FORMAT，只在下一次绘制前有效
+    virtual std::span<const uint32_t> GetRenderedImage() = 0;
     virtual Shader &GetShader() = 0;
     virtual Uniforms &GetUniforms() = 0;
     virtual Camera &GetCamera() = 0;
@@ -45,6 +59,14 @@ class IRenderer {
     virtual void DisableFramework() = 0;
     virtual SDL_Surface *GetSurface() = 0;
     virtual void ToggleFramework() = 0;
+    // 懒清屏：Clear/ClearDepth只标记，块在第一次写入时才填充
+    virtual void SetLazyClear(bool lazy) = 0;
+    // 管线统计，Clear时清零
+    virtual PipelineStats GetStats() = 0;
+    virtual void ResetStats() = 0;
+    // 调试热力图，读回的画面换成热力图；没有编译进来时始终是Off
+    virtual void SetHeatmapMode(HeatmapMode mode) = 0;
+    virtual HeatmapMode GetHeatmapMode() = 0;
 };
 
 // Bresenham对象，用于绘制线段，可用cohen sutherland算法切割
@@ -200,15 +222,21 @@ std::optional<std::tuple<Vec2, Vec2>> CohenSutherland::CohenSutherlandLineClip(
     }
 }
 
-Vec4 TextureSample(Texture &texture, Vec2 &texcoord) {
-    uint32_t x = texcoord.x * (texture.Width() - 1);
-    uint32_t y = texcoord.y * (texture.Height() - 1);
-    auto res = texture.GetPixel(x, y);
-    return texture.GetPixel(x, y);
+Vec4 TextureSample(const Texture &texture, const Sampler &sampler,
+                   Vec2 &texcoord) {
+    return sampler.Sample(texture, texcoord);
+}
+
+// 没有绑定采样器时使用最近邻+边缘截断
+Vec4 TextureSample(const Texture &texture, Vec2 &texcoord) {
+    static const Sampler sampler = Sampler{
+        TextureFilter::Nearest, AddressMode::ClampToEdge,
+        AddressMode::ClampToEdge};
+    return TextureSample(texture, sampler, texcoord);
 }
 
-bool ShouldCull(std::vector<Vec3> &positions, Vec3 &view_dir, FrontFace face,
-                FaceCull cull) {
+bool ShouldCull(std::span<const Vec3> positions, Vec3 &view_dir,
+                FrontFace face, FaceCull cull) {
     auto norm = Cross(positions[1] - positions[0], positions[2] - positions[1]);
     bool is_front_face;
     switch (face) {
@@ -229,10 +257,12 @@ bool ShouldCull(std::vector<Vec3> &positions, Vec3 &view_dir, FrontFace face,
     }
 }
 
-void RasterizeLine(Line &line, PixelShading &shading, Uniforms &uniforms,
-                   TextureStorage &texture_storage,
+void RasterizeLine(Line &line, const PixelShading &shading,
+                   const Uniforms &uniforms,
+                   const TextureStorage &texture_storage,
                    ColorAttachment &color_attachment,
-                   DepthAttachment &depth_attachment) {
+                   DepthAttachment &depth_attachment, PipelineStats &stats,
+                   PixelCostBuffer &pixel_cost) {
     auto p0 = line.start.position.TruncatedToVec2();
     auto p1 = line.end.position.TruncatedToVec2();
     auto bresenhamOpt =
@@ -247,16 +277,23 @@ void RasterizeLine(Line &line, PixelShading &shading, Uniforms &uniforms,
         while (position != std::nullopt) {
             unsigned int x = position.value().x;
             unsigned int y = position.value().y;
+            PixelCostTimer timer(pixel_cost, x, y);
             auto rhw = vertex.position.z;
             float z = 1.0 / rhw;
 
+            stats.pixelsDepthTested++;
+            pixel_cost.CountDepthTest(x, y);
             if (depth_attachment.Get(x, y) < z) {
+                stats.pixelsDepthPassed++;
                 auto attr = vertex.attributes;
                 AttributesForeach(attr,
                                   [=](float value) { return value / rhw; });
+                stats.pixelsShaded++;
+                pixel_cost.CountShade(x, y);
                 auto color = shading(attr, uniforms, texture_storage);
                 color_attachment.Set(x, y, color);
                 depth_attachment.Set(x, y, z);
+                pixel_cost.CountWrite(x, y);
             }
             vertex.position += line.step.position;
             vertex.attributes = InterpAttributes(
@@ -269,3 +306,52 @@ void RasterizeLine(Line &line, PixelShading &shading, Uniforms &uniforms,
         }
     }
 }
+
+// 逐行填充屏幕空间的梯形，只画[row_begin, row_end)之间的行
+// 每行单独从梯形求出扫描线，按行切块分别绘制和整体绘制的结果相同
+void RasterizeTrapezoid(Trapezoid &trap, const PixelShading &shading,
+                        const Uniforms &uniforms,
+                        const TextureStorage &texture_storage,
+                        ColorAttachment &color_attachment,
+                        DepthAttachment &depth_attachment,
+                        PipelineStats &stats, PixelCostBuffer &pixel_cost,
+                        uint32_t row_begin, uint32_t row_end) {
+    int top = std::max(std::ceil(trap.top), row_begin * 1.0f);
+    int bottom = (int)(std::min(std::ceil(trap.bottom), row_end * 1.0f)) - 1;
+    TRACE_ZONE("scanlines");
+
+    VertexRhwInit(trap.left.v1);
+    VertexRhwInit(trap.left.v2);
+    VertexRhwInit(trap.right.v1);
+    VertexRhwInit(trap.right.v2);
+
+    for (int y = top; y <= bottom; y++) {
+        auto scanline = Scanline::FromTrapezoid(trap, y);
+        auto &vertex = scanline.vertex;
+        while (scanline.width > 0.0) {
+            auto rhw = vertex.position.z;
+            auto z = 1.0f / rhw;
+            auto x = vertex.position.x;
+            if (x >= 0.0 && x < color_attachment.width) {
+                PixelCostTimer timer(pixel_cost, x, y);
+                stats.pixelsDepthTested++;
+                pixel_cost.CountDepthTest(x, y);
+                if (depth_attachment.Get(x, y) <= z) {
+                    stats.pixelsDepthPassed++;
+                    auto attr = vertex.attributes;
+                    AttributesScale(attr, z);
+                    stats.pixelsShaded++;
+                    pixel_cost.CountShade(x, y);
+                    auto color = shading(attr, uniforms, texture_storage);
+                    color_attachment.Set(x, y, color);
+                    depth_attachment.Set(x, y, z);
+                    pixel_cost.CountWrite(x, y);
+                }
+            }
+
+            scanline.width -= 1.0;
+            vertex.position += scanline.step.position;
+            AttributesAccumulate(vertex.attributes, scanline.step.attributes);
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "job_system.hpp"
+#include "renderer_factory.hpp"
+#include "scene.hpp"
+
+// 批量渲染中的一帧：相机和模型变换
+struct BatchFrame {
+    Camera camera;
+    Mat44 model;
+};
+
+struct BatchStats {
+    uint32_t frames = 0;
+    uint32_t threads = 0;
+    double seconds = 0.0;
+
+    double FramesPerSecond() const {
+        return seconds > 0.0 ? frames / seconds : 0.0;
+    }
+};
+
+// 按帧并行的批量渲染器
+// 模型只加载一次并在线程间只读共享，每帧是任务系统里的一个任务，
+// 从渲染器池里取一个IRenderer(和附件)来画，帧内的顶点处理和光栅化再拆成子任务
+// 渲染完成的帧按顺序交给回调(在调用Render的线程上执行)，用来写文件等
+class BatchRenderer {
+   public:
+    using FrameCallback =
+        std::function<void(uint32_t index, std::span<const uint32_t> pixels,
+                           uint32_t w, uint32_t h)>;
+
+    BatchRenderer(std::shared_ptr<const Scene> scene, uint32_t w, uint32_t h,
+                  RendererBackend backend = RendererBackend::Gpu,
+                  JobSystem& jobs = JobSystem::Global())
+        : scene_(scene), w_(w), h_(h), backend_(backend), jobs_(jobs) {}
+
+    BatchStats Render(const std::vector<BatchFrame>& frames,
+                      FrameCallback onFrame) {
+        BatchStats stats;
+        stats.threads = jobs_.WorkerCount();
+        if (frames.empty()) {
+            return stats;
+        }
+
+        // 已提交但还没交给回调的帧最多window帧，避免内存无限增长
+        size_t window =
+            std::min<size_t>(jobs_.WorkerCount() * 2, frames.size());
+        std::vector<std::vector<uint32_t>> buffers(window);
+        std::deque<JobCounter> done(frames.size());
+        auto renderFrame = [&](size_t index) {
+            auto slot = acquireRenderer(frames[index].camera);
+            auto& renderer = *slot->renderer;
+            auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+            auto& frame = frames[index];
+            auto model = frame.model;
+            renderer.SetCamera(frame.camera);
+            renderer.Clear(clearColor);
+            renderer.ClearDepth();
+            scene_->Draw(renderer, model, slot->commands);
+            auto pixels = renderer.GetRenderedImage();
+            buffers[index % window].assign(pixels.begin(), pixels.end());
+            releaseRenderer(std::move(slot));
+        };
+        auto submit = [&](size_t index) {
+            // 只捕获两个字，std::function不用在堆上分配
+            jobs_.Run([&renderFrame, index]() { renderFrame(index); },
+                      &done[index]);
+        };
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < window; i++) {
+            submit(i);
+        }
+        // 按顺序交付，等待期间当前线程也参与渲染
+        for (size_t i = 0; i < frames.size(); i++) {
+            jobs_.Wait(done[i]);
+            if (onFrame) {
+                onFrame(i, buffers[i % window], w_, h_);
+            }
+            if (i + window < frames.size()) {
+                submit(i + window);
+            }
+        }
+        std::chrono::duration<double> elapse =
+            std::chrono::high_resolution_clock::now() - start;
+        stats.frames = frames.size();
+        stats.seconds = elapse.count();
+        return stats;
+    }
+
+   private:
+    std::shared_ptr<const Scene> scene_;
+    uint32_t w_;
+    uint32_t h_;
+    RendererBackend backend_;
+    JobSystem& jobs_;
+    // 渲染器和它每帧复用的绘制命令
+    struct RendererSlot {
+        std::unique_ptr<IRenderer> renderer;
+        CommandBuffer commands{UNIFORM_TEXTURE};
+    };
+
+    // 空闲的渲染器；调用Render的线程在等待时也会执行帧任务，它不是工作线程，
+    // 没有线程编号，所以不按线程分配，同时在画的帧有几个就只建几个
+    std::mutex poolMutex_;
+    std::vector<std::unique_ptr<RendererSlot>> pool_;
+
+    std::unique_ptr<RendererSlot> acquireRenderer(const Camera& camera) {
+        {
+            std::lock_guard<std::mutex> lock(poolMutex_);
+            if (!pool_.empty()) {
+                auto slot = std::move(pool_.back());
+                pool_.pop_back();
+                return slot;
+            }
+        }
+        auto slot = std::make_unique<RendererSlot>();
+        slot->renderer = CreateRenderer(w_, h_, camera, backend_);
+        SetupRenderer(*slot->renderer);
+        return slot;
+    }
+
+    void releaseRenderer(std::unique_ptr<RendererSlot> slot) {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        pool_.push_back(std::move(slot));
+    }
+};
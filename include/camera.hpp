@@ -14,18 +14,8 @@ class Frustum {
 
     Frustum(float near, float far, float aspect, float fov)
         : near(near), far(far), aspect(aspect), fov(fov) {
-#ifdef CPU_FEATURE_ENABLED
-        // Code to be executed when the "cpu" feature is enabled
-        float a = 1.0f / (near * std::tan(fov * 0.5));
-        // clang-format off
-        mat = Mat44(std::initializer_list<real>{
-            a,          0,          0, 0, 
-            0, aspect * a,          0, 0,
-            0,          0,        1.0, 0,
-            0,          0, -1.0f/near, 0});
-        // clang-format on
-#else
-        // Code to be executed when the "cpu" feature is not enabled
+        // 两种渲染器共用OpenGL的投影约定：fov是竖直方向的视角，
+        // 投影后w=-z，屏幕空间的深度直接取-w
         // Since glFrustum() accepts only positive values of near and far
         // distances, we need to negate them during the construction of
         // GL_PROJECTION matrix.
@@ -39,23 +29,6 @@ class Frustum {
                                 0,          0,(near + far) / (near - far), -2 * near * far / (far - near), 
                                 0,          0,                          -1,                             0});
         // clang-format on
-
-#endif
-    }
-
-    // 视锥剔除
-    bool Contain(Vec3& pt) {
-        float half_h = near * std::tan(fov * 0.5) / aspect;
-        float h_fovy_cos = std::cos(fov / 2);
-        float h_fovy_sin = std::sin(fov / 2);
-        // 以下都是法线
-        return !(
-            Dot(Vec3{h_fovy_cos, 0.0, h_fovy_sin}, pt) >= 0.0  // right plane
-            || Dot(Vec3{-h_fovy_cos, 0.0, h_fovy_sin}, pt) >= 0.0  // left plane
-            || Dot(Vec3{0.0, near, half_h}, pt) >= 0.0             // top plane
-            || Dot(Vec3{0.0, -near, half_h}, pt) >= 0.0  // bottom plane
-            || pt.z >= -near                             // near plane
-            || pt.z <= -far);                            // far plane
     }
 };
 
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "base_renderer.hpp"
+
+// 一次绘制用到的管线状态：着色器和三角形的剔除设置
+struct PipelineState {
+    Shader shader;
+    FrontFace frontFace = FrontFace::CCW;
+    FaceCull cull = FaceCull::Back;
+};
+
+// 录制下来的一次绘制，uniform和贴图绑定是录制时的快照
+struct DrawCommand {
+    // CommandBuffer中管线的下标
+    uint32_t pipeline;
+    Uniforms uniforms;
+    // 贴图绑定，排序时从uniforms里取出来
+    std::optional<uint32_t> texture;
+    Mat44 model;
+    std::span<const Vertex> vertices;
+    const TextureStorage *textureStorage;
+    // 到相机的距离，用于从前往后排序
+    float depth;
+};
+
+enum class DrawOrder {
+    // 按录制顺序
+    Recorded,
+    // 按管线、贴图分组，组内从前往后，减少状态切换
+    State,
+    // 从前往后，前面画过的像素让后面的绘制在着色之前就被深度测试剔除
+    FrontToBack,
+};
+
+// 先录制再执行的绘制命令列表
+// 录制时不改变渲染器的状态；Submit时按排好的顺序执行，只在管线变化时
+// 切换着色器和剔除设置，执行完恢复渲染器原来的状态
+// Reset不释放命令，下次录制原地覆盖：每帧录制相同的场景时，uniform的复制
+// 会复用map节点，排序只排下标，整个录制和提交过程不再分配内存
+class CommandBuffer {
+   public:
+    // textureSlot是贴图绑定所在的uniform槽位，按贴图排序时使用
+    explicit CommandBuffer(uint32_t textureSlot = 0)
+        : textureSlot_(textureSlot) {}
+
+    void Reset() {
+        pipelineCount_ = 0;
+        order_.clear();
+    }
+
+    size_t Size() const { return order_.size(); }
+
+    uint32_t AddPipeline(PipelineState state) {
+        if (pipelineCount_ < pipelines_.size()) {
+            pipelines_[pipelineCount_] = std::move(state);
+        } else {
+            pipelines_.push_back(std::move(state));
+        }
+        return pipelineCount_++;
+    }
+
+    // 以渲染器当前的着色器和剔除设置作为一个管线
+    uint32_t CapturePipeline(IRenderer &renderer) {
+        return AddPipeline(PipelineState{renderer.GetShader(),
+                                         renderer.GetFrontFace(),
+                                         renderer.GetFaceCull()});
+    }
+
+    // 返回这条命令的uniform快照，调用方可以在上面继续设置这次绘制自己的值
+    Uniforms &Draw(uint32_t pipeline, const Uniforms &uniforms,
+                   const Mat44 &model, std::span<const Vertex> vertices,
+                   const TextureStorage &textureStorage, float depth = 0.0f) {
+        uint32_t index = order_.size();
+        if (index == commands_.size()) {
+            commands_.emplace_back();
+        }
+        auto &command = commands_[index];
+        command.pipeline = pipeline;
+        command.uniforms = uniforms;
+        command.model = model;
+        command.vertices = vertices;
+        command.textureStorage = &textureStorage;
+        command.depth = depth;
+        order_.push_back(index);
+        return command.uniforms;
+    }
+
+    // 相同键的命令保持录制顺序
+    void Sort(DrawOrder order) {
+        switch (order) {
+            case DrawOrder::Recorded:
+                break;
+            case DrawOrder::State:
+                for (auto index : order_) {
+                    auto &command = commands_[index];
+                    auto it = command.uniforms.varyingTexuture.find(
+                        textureSlot_);
+                    command.texture =
+                        it == command.uniforms.varyingTexuture.end()
+                            ? std::nullopt
+                            : std::optional<uint32_t>(it->second);
+                }
+                sortBy([](const DrawCommand &a, const DrawCommand &b) {
+                    if (a.pipeline != b.pipeline) {
+                        return a.pipeline < b.pipeline;
+                    }
+                    if (a.texture != b.texture) {
+                        return a.texture < b.texture;
+                    }
+                    return a.depth < b.depth;
+                });
+                break;
+            case DrawOrder::FrontToBack:
+                sortBy([](const DrawCommand &a, const DrawCommand &b) {
+                    return a.depth < b.depth;
+                });
+                break;
+        }
+    }
+
+    void Submit(IRenderer &renderer) {
+        if (order_.empty()) {
+            return;
+        }
+        saved_.shader = renderer.GetShader();
+        saved_.frontFace = renderer.GetFrontFace();
+        saved_.cull = renderer.GetFaceCull();
+        std::optional<uint32_t> bound;
+        for (auto index : order_) {
+            auto &command = commands_[index];
+            if (bound != command.pipeline) {
+                bindPipeline(renderer, pipelines_[command.pipeline]);
+                bound = command.pipeline;
+            }
+            // 交换而不是复制，画完再换回来，渲染器自己的uniform原样保留
+            std::swap(renderer.GetUniforms(), command.uniforms);
+            renderer.DrawTriangle(command.model, command.vertices,
+                                  *command.textureStorage);
+            std::swap(renderer.GetUniforms(), command.uniforms);
+        }
+        bindPipeline(renderer, saved_);
+    }
+
+   private:
+    uint32_t textureSlot_;
+    std::vector<PipelineState> pipelines_;
+    uint32_t pipelineCount_ = 0;
+    // 命令只增不减，这一次录制的命令按执行顺序记在order_里
+    std::vector<DrawCommand> commands_;
+    std::vector<uint32_t> order_;
+    PipelineState saved_;
+
+    // 只排下标；键相同时按录制顺序，结果和稳定排序一样
+    template <typename Less>
+    void sortBy(Less less) {
+        std::sort(order_.begin(), order_.end(),
+                  [&](uint32_t a, uint32_t b) {
+                      if (less(commands_[a], commands_[b])) {
+                          return true;
+                      }
+                      if (less(commands_[b], commands_[a])) {
+                          return false;
+                      }
+                      return a < b;
+                  });
+    }
+
+    static void bindPipeline(IRenderer &renderer, const PipelineState &state) {
+        renderer.GetShader() = state.shader;
+        renderer.SetFrontFace(state.frontFace);
+        renderer.SetFaceCull(state.cull);
+    }
+};
@@ -2,8 +2,6 @@
 #include "base_renderer.hpp"
 #include "scanline.hpp"
 
-enum RasterizeResult { Ok, Discard, GenerateNewFace };
-
 class CpuRenderer : public IRenderer {
    private:
     ColorAttachment colorAttachment_;
@@ -14,140 +12,133 @@ class CpuRenderer : public IRenderer {
     Uniforms uniforms_;
     FrontFace frontFace_;
     FaceCull cull_;
-
-    std::vector<Vertex> clipedTrangles_;
     bool enableFramework_;
 
-    void drawScanline(Scanline &scanline, TextureStorage &textureStorage) {
-        auto &vertex = scanline.vertex;
-        auto y = scanline.y;
-        while (scanline.width > 0.0) {
-            auto rhw = vertex.position.z;
-            auto z = 1.0f / rhw;
-            auto x = vertex.position.x;
-            if (x >= 0.0 && x < colorAttachment_.width) {
-                if (depthAttachment_.Get(x, y) <= z) {
-                    auto attr = vertex.attributes;
-                    AttributesForeach(attr,
-                                      [=](float value) { return value / rhw; });
-                    auto color = shader_.CallPixelShading(attr, uniforms_,
-                                                          textureStorage);
-                    colorAttachment_.Set(x, y, color);
-                    depthAttachment_.Set(x, y, z);
+    // 顶点阶段的结果，按顶点下标存放，在帧之间复用
+    std::vector<Vertex> shadedVertices_;
+    Vec4Stream worldPositions_;
+    Vec4Stream viewPositions_;
+    Vec4Stream screenPositions_;
+    // 光栅化只在调用DrawTriangle的线程上进行，直接计数
+    PipelineStats stats_;
+    // 调试热力图的计数，只在打开时记录
+    PixelCostBuffer pixelCost_;
+    HeatmapMode heatmap_ = HeatmapMode::Off;
+
+    // 整个mesh的顶点一起变换，世界空间的位置用于背面剔除，
+    // view空间的位置用于视锥剔除和裁剪，屏幕空间的位置用于光栅化
+    // 顶点多时分成几段在任务线程上处理
+    void processVertices(Mat44 &model, std::span<const Vertex> vertices,
+                         const TextureStorage &textureStorage) {
+        TRACE_ZONE("vertex processing");
+        auto count = vertices.size();
+        shadedVertices_.assign(vertices.begin(), vertices.end());
+        worldPositions_.Resize(count);
+        viewPositions_.Resize(count);
+        screenPositions_.Resize(count);
+        auto mapping = screenMapping();
+        JobSystem::Global().ParallelFor(
+            0, count, VERTEX_JOB_GRAIN, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    auto &v = shadedVertices_[i];
+                    v = shader_.CallVertexChanging(v, uniforms_,
+                                                   textureStorage);
+                    worldPositions_.Set(i, v.position);
                 }
-            }
-
-            scanline.width -= 1.0;
-            vertex.position += scanline.step.position;
-            vertex.attributes = InterpAttributes(
-                vertex.attributes, scanline.step.attributes,
-                [](float value1, float value2, float) {
-                    return value1 + value2;
-                },
-                0.0);
-        }
+                auto world = worldPositions_.View().Offset(first);
+                auto view = viewPositions_.View().Offset(first);
+                auto screen = screenPositions_.View().Offset(first);
+                TransformPoints(model, world, world, last - first);
+                TransformPoints(camera_.view_mat_, world, view, last - first);
+                ProjectToScreen(camera_.frustum_.mat, mapping, view, screen,
+                                last - first);
+            });
     }
 
-    void drawTrapezoid(Trapezoid &trap, TextureStorage &textureStorage) {
-        int top = std::max(std::ceil(trap.top), 0.0f);
-        int bottom = (int)(std::min(std::ceil(trap.bottom),
-                                    colorAttachment_.height - 1.0f)) -
-                     1;
-        float y = top;
-
-        VertexRhwInit(trap.left.v1);
-        VertexRhwInit(trap.left.v2);
-        VertexRhwInit(trap.right.v1);
-        VertexRhwInit(trap.right.v2);
-
-        while (y <= bottom) {
-            auto scanline = Scanline::FromTrapezoid(trap, y);
-            drawScanline(scanline, textureStorage);
-            y += 1;
-        }
+    // 投影后w=-z，保存的深度就是真实的z
+    ScreenMapping screenMapping() const {
+        return ScreenMapping::FromViewport(viewport_.x, viewport_.y,
+                                           viewport_.w, viewport_.h, 1.0f);
     }
 
-    RasterizeResult rasterizeTriangle(Mat44 &model,
-                                      std::vector<Vertex> &vertices,
-                                      TextureStorage &textureStorage) {
-        // call vertex changing function to change vertex position and set
-        // attribtues
-        for (auto &v : vertices) {
-            v = shader_.CallVertexChanging(v, uniforms_, textureStorage);
-        }
-
-        // Model transform
-        for (auto &v : vertices) {
-            v.position = model * v.position;
+    // 光栅化processVertices处理过的第first个三角形
+    void rasterizeProcessed(size_t first,
+                            const TextureStorage &textureStorage) {
+        std::array<Vec3, 3> positions;
+        for (size_t k = 0; k < 3; k++) {
+            positions[k] = worldPositions_.GetVec3(first + k);
         }
-
-        std::vector<Vec3> positions;
-        std::transform(vertices.begin(), vertices.end(),
-                       std::back_inserter(positions),
-                       [](Vertex v) { return v.position.TruncatedToVec3(); });
-
         // face cull
         if (ShouldCull(positions, camera_.view_dir_, frontFace_, cull_)) {
-            return RasterizeResult::Discard;
+            stats_.trianglesBackfaceCulled++;
+            return;
         }
 
-        // view transform
-        for (auto &v : vertices) {
-            v.position = camera_.view_mat_ * v.position;
+        // 三个顶点都在同一个平面外侧时整个剔除，都在视锥内时不用裁剪
+        std::array<Vec4, 3> clipPositions;
+        uint32_t outsideAll = ~0u;
+        uint32_t outsideAny = 0;
+        for (size_t k = 0; k < 3; k++) {
+            clipPositions[k] =
+                camera_.frustum_.mat * viewPositions_.Get(first + k);
+            auto code = ClipOutcode(clipPositions[k]);
+            outsideAll &= code;
+            outsideAny |= code;
         }
-
-        std::transform(vertices.begin(), vertices.end(),
-                       std::back_inserter(positions),
-                       [](Vertex v) { return v.position.TruncatedToVec3(); });
-
-        // frustum clip
-        bool frustumClip = true;
-        for (auto &p : positions) {
-            if (camera_.frustum_.Contain(p)) {
-                frustumClip = false;
-                break;
-            }
-        }
-        if (frustumClip) {
-            return RasterizeResult::Discard;
+        if (outsideAll != 0) {
+            stats_.trianglesFrustumCulled++;
+            return;
         }
 
-        // near plane clip
-        bool nearPlaneClip = false;
-        for (auto &p : positions) {
-            if (p.z > camera_.frustum_.near) {
-                nearPlaneClip = true;
-                break;
+        Triangle vertices{shadedVertices_[first], shadedVertices_[first + 1],
+                          shadedVertices_[first + 2]};
+        if (outsideAny != 0) {
+            for (size_t k = 0; k < 3; k++) {
+                vertices[k].position = clipPositions[k];
             }
+            clipTriangle(vertices, outsideAny, textureStorage);
+            return;
         }
-        if (nearPlaneClip) {
-            auto [face1, face2Opt] =
-                NearPlaneClip(vertices, camera_.frustum_.near);
-            for (auto &v : face1) clipedTrangles_.push_back(v);
-            if (face2Opt.has_value()) {
-                for (auto &v : face2Opt.value()) clipedTrangles_.push_back(v);
-            }
-            return RasterizeResult::GenerateNewFace;
+        for (size_t k = 0; k < 3; k++) {
+            vertices[k].position = screenPositions_.Get(first + k);
         }
+        rasterizeScreenTriangle(vertices, textureStorage);
+    }
 
+    // vertices在裁剪空间，只用planes中的平面裁剪；
+    // 裁剪出的凸多边形变换到屏幕空间后按扇形拆成三角形直接光栅化
+    void clipTriangle(std::span<const Vertex> vertices, uint32_t planes,
+                      const TextureStorage &textureStorage) {
+        TRACE_ZONE("clip");
+        ClippedPolygon polygon;
         for (auto &v : vertices) {
-            // project transform
-            v.position = camera_.frustum_.mat * v.position;
-            // save truely z
-            // frustum的矩阵中w=-z/near，需要还原回去
-            v.position.z = -v.position.w * camera_.frustum_.near;
-            // perspective divide
-            v.position.x /= v.position.w;
-            v.position.y /= v.position.w;
-            v.position.w = 1.0;
-            // Viewport transform
-            v.position.x =
-                (v.position.x + 1.0) * 0.5 * (viewport_.w - 1.0) + viewport_.x;
-            v.position.y = viewport_.h -
-                           (v.position.y + 1.0) * 0.5 * (viewport_.h - 1.0) +
-                           viewport_.y;
+            polygon.push_back(v);
         }
+        ClipPolygon(polygon, planes);
+        stats_.trianglesClipped++;
+        if (polygon.size() < 3) {
+            return;
+        }
+        stats_.trianglesGenerated += polygon.size() - 2;
+        auto mapping = screenMapping();
+        for (auto &v : polygon) {
+            v.position = mapping.ToScreen(v.position);
+        }
+        for (size_t i = 1; i + 1 < polygon.size(); i++) {
+            Triangle triangle{polygon[0], polygon[i], polygon[i + 1]};
+            rasterizeScreenTriangle(triangle, textureStorage);
+        }
+    }
 
+    void drawTrapezoid(Trapezoid &trap, const TextureStorage &textureStorage) {
+        RasterizeTrapezoid(trap, shader_.pixelShading, uniforms_,
+                           textureStorage, colorAttachment_, depthAttachment_,
+                           stats_, pixelCost_, 0, colorAttachment_.height);
+    }
+
+    // vertices已经在屏幕空间
+    void rasterizeScreenTriangle(std::span<const Vertex> vertices,
+                                 const TextureStorage &textureStorage) {
         if (enableFramework_) {
             // draw line framework
             for (int i = 0; i < 3; i++) {
@@ -158,10 +149,16 @@ class CpuRenderer : public IRenderer {
                 Line line = Line{v1, v2};
                 RasterizeLine(line, shader_.pixelShading, uniforms_,
                               textureStorage, colorAttachment_,
-                              depthAttachment_);
+                              depthAttachment_, stats_, pixelCost_);
             }
         } else {
-            auto [trap1Opt, trap2Opt] = Trapezoid::FromTriangle(vertices);
+            std::optional<Trapezoid> trap1Opt;
+            std::optional<Trapezoid> trap2Opt;
+            {
+                TRACE_ZONE("trapezoid setup");
+                std::tie(trap1Opt, trap2Opt) =
+                    Trapezoid::FromTriangle(vertices);
+            }
             if (trap1Opt.has_value()) {
                 drawTrapezoid(trap1Opt.value(), textureStorage);
             }
@@ -169,7 +166,6 @@ class CpuRenderer : public IRenderer {
                 drawTrapezoid(trap2Opt.value(), textureStorage);
             }
         }
-        return RasterizeResult::Ok;
     }
 
    public:
@@ -184,55 +180,32 @@ class CpuRenderer : public IRenderer {
           uniforms_(Uniforms{}),
           frontFace_(FrontFace::CW),
           cull_(FaceCull::None),
-          clipedTrangles_(std::vector<Vertex>()),
-          enableFramework_(false) {}
-
-    void Clear(Vec4 &color) override { colorAttachment_.Clear(color); }
+          enableFramework_(false),
+          pixelCost_(w, h) {}
+
+    void Clear(Vec4 &color) override {
+        TRACE_ZONE("clear");
+        colorAttachment_.Clear(color);
+        stats_ = PipelineStats{};
+        pixelCost_.Clear();
+    }
 
     uint32_t GetCanvaWidth() override { return colorAttachment_.width; }
 
     uint32_t GetCanvaHeight() override { return colorAttachment_.height; }
 
-    std::vector<uint8_t> GetRenderedImage() override {
-        return colorAttachment_.data;
+    std::span<const uint32_t> GetRenderedImage() override {
+        pixelCost_.Render(heatmap_, colorAttachment_);
+        return colorAttachment_.Pixels();
     }
 
-    void DrawTriangle(Mat44 &model, std::vector<Vertex> &vertices,
-                      TextureStorage &textureStorage) override {
-        for (int i = 0; i < vertices.size() / 3; i++) {
-            std::vector<Vertex> vertices_ = std::vector<Vertex>{
-                vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2]};
-            auto result = rasterizeTriangle(model, vertices_, textureStorage);
-
-            switch (result) {
-                case RasterizeResult::Ok:
-                case RasterizeResult::Discard:
-                    break;
-                case RasterizeResult::GenerateNewFace:
-                    for (int i = 0; i < clipedTrangles_.size() / 3; i++) {
-                        auto vertices_ = std::vector<Vertex>{
-                            clipedTrangles_[i * 3], clipedTrangles_[i * 3 + 1],
-                            clipedTrangles_[i * 3 + 2]};
-                        auto result_ =
-                            rasterizeTriangle(model, vertices_, textureStorage);
-                        switch (result_) {
-                            case RasterizeResult::Ok:
-
-                                break;
-                            case RasterizeResult::Discard:
-                            case RasterizeResult::GenerateNewFace:
-                                SDL_Log(
-                                    "discard or generate new face from clipped "
-                                    "face");
-                                break;
-                            default:
-                                break;
-                        }
-                        clipedTrangles_.clear();
-                    }
-                default:
-                    break;
-            }
+    void DrawTriangle(Mat44 &model, std::span<const Vertex> vertices,
+                      const TextureStorage &textureStorage) override {
+        processVertices(model, vertices, textureStorage);
+        stats_.verticesShaded += vertices.size();
+        stats_.trianglesSubmitted += vertices.size() / 3;
+        for (size_t i = 0; i + 3 <= vertices.size(); i += 3) {
+            rasterizeProcessed(i, textureStorage);
         }
     }
 
@@ -262,8 +235,30 @@ class CpuRenderer : public IRenderer {
     void DisableFramework() override { enableFramework_ = false; }
 
     SDL_Surface *GetSurface() override {
+        pixelCost_.Render(heatmap_, colorAttachment_);
         return colorAttachment_.ConvertToSurface();
     }
 
     void ToggleFramework() override { enableFramework_ = !enableFramework_; }
+
+    void SetLazyClear(bool lazy) override {
+        colorAttachment_.SetLazyClear(lazy);
+        depthAttachment_.SetLazyClear(lazy);
+    }
+
+    PipelineStats GetStats() override {
+        auto stats = stats_;
+        stats.canvasPixels =
+            uint64_t(colorAttachment_.width) * colorAttachment_.height;
+        return stats;
+    }
+
+    void ResetStats() override { stats_ = PipelineStats{}; }
+
+    void SetHeatmapMode(HeatmapMode mode) override {
+        pixelCost_.SetActive(mode != HeatmapMode::Off);
+        heatmap_ = pixelCost_.Active() ? mode : HeatmapMode::Off;
+    }
+
+    HeatmapMode GetHeatmapMode() override { return heatmap_; }
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image.hpp"
+#include "trace.hpp"
+
+// 调试热力图：逐像素记录深度测试、写入和着色的次数，按块记录光栅化耗时，
+// 画面读回时用热力图替换着色结果，用来看哪里overdraw高、哪些块最费时
+// 计数只在定义了SOFTRENDER_DEBUG_VIEW时编译进来(CMake的Debug配置默认定义)，
+// 否则记录函数都是空的，也不占内存
+
+enum class HeatmapMode {
+    Off,
+    DepthTested,
+    Written,
+    // 目前着色器不会丢弃像素，和Written相同
+    Shaded,
+    TileTime,
+};
+
+inline const char *HeatmapModeName(HeatmapMode mode) {
+    switch (mode) {
+        case HeatmapMode::Off:
+            return "off";
+        case HeatmapMode::DepthTested:
+            return "depth tested";
+        case HeatmapMode::Written:
+            return "written";
+        case HeatmapMode::Shaded:
+            return "shaded";
+        case HeatmapMode::TileTime:
+            return "tile time";
+    }
+    return "";
+}
+
+// 按键循环切换时的下一个模式
+inline HeatmapMode NextHeatmapMode(HeatmapMode mode) {
+    return mode == HeatmapMode::TileTime
+               ? HeatmapMode::Off
+               : HeatmapMode(static_cast<int>(mode) + 1);
+}
+
+// 命令行的名字：depth、written、shaded、tile
+inline std::optional<HeatmapMode> ParseHeatmapMode(const std::string &name) {
+    if (name == "off") {
+        return HeatmapMode::Off;
+    } else if (name == "depth") {
+        return HeatmapMode::DepthTested;
+    } else if (name == "written") {
+        return HeatmapMode::Written;
+    } else if (name == "shaded") {
+        return HeatmapMode::Shaded;
+    } else if (name == "tile") {
+        return HeatmapMode::TileTime;
+    }
+    return std::nullopt;
+}
+
+// 0~1映射到黑、蓝、青、绿、黄、红、白；计数按8次为满，
+// 每多画一次颜色跨一档
+inline Vec4 HeatColor(float t) {
+    static const std::array<std::pair<float, Vec4>, 7> STOPS = {{
+        {0.0f, Vec4{0.0, 0.0, 0.0, 1.0}},
+        {0.125f, Vec4{0.0, 0.0, 1.0, 1.0}},
+        {0.25f, Vec4{0.0, 1.0, 1.0, 1.0}},
+        {0.375f, Vec4{0.0, 1.0, 0.0, 1.0}},
+        {0.5f, Vec4{1.0, 1.0, 0.0, 1.0}},
+        {0.75f, Vec4{1.0, 0.0, 0.0, 1.0}},
+        {1.0f, Vec4{1.0, 1.0, 1.0, 1.0}},
+    }};
+    t = std::clamp(t, 0.0f, 1.0f);
+    for (size_t i = 1; i < STOPS.size(); i++) {
+        if (t <= STOPS[i].first) {
+            auto &[t0, c0] = STOPS[i - 1];
+            auto &[t1, c1] = STOPS[i];
+            return Lerp(c0, c1, (t - t0) / (t1 - t0));
+        }
+    }
+    return STOPS.back().second;
+}
+
+// 和DepthAttachment同样大小的计数缓冲，只在热力图打开时记录
+// 耗时按懒清屏的块统计；光栅化的行块和它对齐，并行时每个块只有一个任务写
+class PixelCostBuffer {
+   public:
+    // 计数达到这个值显示为白色
+    static constexpr uint32_t MAX_HEAT_COUNT = 8;
+
+    PixelCostBuffer(uint32_t w, uint32_t h)
+        : width_(w),
+          height_(h),
+          tilesX_((w + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_SHIFT),
+          tilesY_((h + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_SHIFT) {}
+
+    static constexpr bool Enabled() {
+#ifdef SOFTRENDER_DEBUG_VIEW
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool Active() const { return Enabled() && active_; }
+
+    // 打开时才分配计数缓冲
+    void SetActive(bool active) {
+        if (!Enabled()) {
+            return;
+        }
+        active_ = active;
+        if (active && depthTested_.empty()) {
+            auto count = size_t(width_) * height_;
+            depthTested_.resize(count);
+            written_.resize(count);
+            shaded_.resize(count);
+            tileTicks_.resize(size_t(tilesX_) * tilesY_);
+        }
+    }
+
+    // 每帧开始时清零
+    void Clear() {
+        if (!Active()) {
+            return;
+        }
+        std::fill(depthTested_.begin(), depthTested_.end(), 0);
+        std::fill(written_.begin(), written_.end(), 0);
+        std::fill(shaded_.begin(), shaded_.end(), 0);
+        std::fill(tileTicks_.begin(), tileTicks_.end(), 0);
+    }
+
+    void CountDepthTest(uint32_t x, uint32_t y) {
+#ifdef SOFTRENDER_DEBUG_VIEW
+        if (active_) {
+            depthTested_[x + y * width_]++;
+        }
+#endif
+    }
+
+    void CountWrite(uint32_t x, uint32_t y) {
+#ifdef SOFTRENDER_DEBUG_VIEW
+        if (active_) {
+            written_[x + y * width_]++;
+        }
+#endif
+    }
+
+    void CountShade(uint32_t x, uint32_t y) {
+#ifdef SOFTRENDER_DEBUG_VIEW
+        if (active_) {
+            shaded_[x + y * width_]++;
+        }
+#endif
+    }
+
+    void AddTileTicks(uint32_t x, uint32_t y, uint64_t ticks) {
+#ifdef SOFTRENDER_DEBUG_VIEW
+        if (active_) {
+            tileTicks_[(y >> CLEAR_TILE_SHIFT) * tilesX_ +
+                       (x >> CLEAR_TILE_SHIFT)] += ticks;
+        }
+#endif
+    }
+
+    // 用mode对应的热力图覆盖color；耗时按这一帧最慢的块归一化
+    void Render(HeatmapMode mode, ColorAttachment &color) const {
+        if (!Active() || mode == HeatmapMode::Off) {
+            return;
+        }
+        if (mode == HeatmapMode::TileTime) {
+            auto maxTicks =
+                *std::max_element(tileTicks_.begin(), tileTicks_.end());
+            for (uint32_t y = 0; y < height_; y++) {
+                for (uint32_t x = 0; x < width_; x++) {
+                    auto ticks = tileTicks_[(y >> CLEAR_TILE_SHIFT) * tilesX_ +
+                                            (x >> CLEAR_TILE_SHIFT)];
+                    color.Set(x, y,
+                              HeatColor(maxTicks > 0 ? float(ticks) / maxTicks
+                                                     : 0.0f));
+                }
+            }
+            return;
+        }
+        auto &counts = mode == HeatmapMode::DepthTested ? depthTested_
+                       : mode == HeatmapMode::Written   ? written_
+                                                        : shaded_;
+        for (uint32_t y = 0; y < height_; y++) {
+            for (uint32_t x = 0; x < width_; x++) {
+                color.Set(x, y,
+                          HeatColor(float(counts[x + y * width_]) /
+                                    MAX_HEAT_COUNT));
+            }
+        }
+    }
+
+   private:
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t tilesX_;
+    uint32_t tilesY_;
+    bool active_ = false;
+    std::vector<uint32_t> depthTested_;
+    std::vector<uint32_t> written_;
+    std::vector<uint32_t> shaded_;
+    std::vector<uint64_t> tileTicks_;
+};
+
+// 一个像素的光栅化耗时，析构时计入所在的块；热力图没打开时不读时钟
+class PixelCostTimer {
+   public:
+#ifdef SOFTRENDER_DEBUG_VIEW
+    PixelCostTimer(PixelCostBuffer &buffer, uint32_t x, uint32_t y)
+        : buffer_(buffer.Active() ? &buffer : nullptr),
+          x_(x),
+          y_(y),
+          begin_(buffer_ ? trace::Now() : 0) {}
+
+    ~PixelCostTimer() {
+        if (buffer_) {
+            buffer_->AddTileTicks(x_, y_, trace::Now() - begin_);
+        }
+    }
+#else
+    PixelCostTimer(PixelCostBuffer &, uint32_t, uint32_t) {}
+#endif
+
+    PixelCostTimer(const PixelCostTimer &) = delete;
+    PixelCostTimer &operator=(const PixelCostTimer &) = delete;
+
+#ifdef SOFTRENDER_DEBUG_VIEW
+   private:
+    PixelCostBuffer *buffer_;
+    uint32_t x_;
+    uint32_t y_;
+    uint64_t begin_;
+#endif
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <new>
+
+// 容量固定、元素直接存放在对象里的vector，不在堆上分配
+// 用来放三角形、裁剪结果这类大小有上限的临时数据；超出容量是调用方的错误
+// 接口和std::vector一致，可以直接用于范围for、标准算法和std::span
+template <typename T, size_t N>
+class FixedVector {
+   public:
+    FixedVector() = default;
+
+    FixedVector(std::initializer_list<T> values) {
+        for (auto &value : values) {
+            push_back(value);
+        }
+    }
+
+    FixedVector(const FixedVector &other) {
+        for (auto &value : other) {
+            push_back(value);
+        }
+    }
+
+    FixedVector &operator=(const FixedVector &other) {
+        if (this != &other) {
+            clear();
+            for (auto &value : other) {
+                push_back(value);
+            }
+        }
+        return *this;
+    }
+
+    ~FixedVector() { clear(); }
+
+    void push_back(const T &value) {
+        assert(size_ < N);
+        new (data() + size_) T(value);
+        size_++;
+    }
+
+    void clear() {
+        std::destroy_n(data(), size_);
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    static constexpr size_t capacity() { return N; }
+
+    T *data() { return std::launder(reinterpret_cast<T *>(storage_)); }
+    const T *data() const {
+        return std::launder(reinterpret_cast<const T *>(storage_));
+    }
+
+    T *begin() { return data(); }
+    T *end() { return data() + size_; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size_; }
+
+    T &operator[](size_t index) {
+        assert(index < size_);
+        return data()[index];
+    }
+    const T &operator[](size_t index) const {
+        assert(index < size_);
+        return data()[index];
+    }
+
+    T &back() { return (*this)[size_ - 1]; }
+
+   private:
+    alignas(T) std::byte storage_[sizeof(T) * N];
+    size_t size_ = 0;
+};
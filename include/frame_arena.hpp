@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// 按帧重置的线性分配器：分配只是移动偏移，Reset一次释放这一帧的所有分配
+// 当前块不够时再申请一块，Reset时把所有块合并成一整块，
+// 所以每帧用量稳定之后不再向系统申请内存
+// 只放平凡析构的类型，Reset时不调用析构函数；不是线程安全的
+class FrameArena {
+   public:
+    explicit FrameArena(size_t capacity = 0) {
+        if (capacity > 0) {
+            blocks_.push_back(makeBlock(capacity));
+        }
+    }
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+    FrameArena(FrameArena &&) = default;
+    FrameArena &operator=(FrameArena &&) = default;
+
+    // 分配count个默认初始化的T，到下一次Reset之前有效
+    template <typename T>
+    std::span<T> Allocate(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+        if (count == 0) {
+            return {};
+        }
+        auto data = static_cast<T *>(allocateBytes(sizeof(T) * count,
+                                                   alignof(T)));
+        std::uninitialized_default_construct_n(data, count);
+        return {data, count};
+    }
+
+    void Reset() {
+        if (blocks_.size() > 1) {
+            auto total = Capacity();
+            blocks_.clear();
+            blocks_.push_back(makeBlock(total));
+        }
+        offset_ = 0;
+    }
+
+    size_t Capacity() const {
+        size_t total = 0;
+        for (auto &block : blocks_) {
+            total += block.size;
+        }
+        return total;
+    }
+
+   private:
+    // 第一次分配时至少申请这么大
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    // 分配都在最后一块里，offset_是最后一块已用的字节数
+    std::vector<Block> blocks_;
+    size_t offset_ = 0;
+
+    static Block makeBlock(size_t size) {
+        return Block{std::make_unique_for_overwrite<std::byte[]>(size), size};
+    }
+
+    void *allocateBytes(size_t bytes, size_t align) {
+        auto aligned = (offset_ + align - 1) / align * align;
+        if (blocks_.empty() || aligned + bytes > blocks_.back().size) {
+            auto last = blocks_.empty() ? 0 : blocks_.back().size;
+            blocks_.push_back(
+                makeBlock(std::max({bytes, last * 2, MIN_BLOCK_SIZE})));
+            aligned = 0;
+        }
+        offset_ = aligned + bytes;
+        return blocks_.back().data.get() + aligned;
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "SDL.h"
+#include "SDL_image.h"
+#include "image.hpp"
+
+// 把帧缓冲(FRAMEBUFFER_FORMAT)写成二进制PPM(P6)，不依赖SDL
+bool WritePPM(const std::string &filename, std::span<const uint32_t> pixels,
+              uint32_t w, uint32_t h) {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        SDL_Log("open %s failed", filename.c_str());
+        return false;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", w, h);
+    std::vector<uint8_t> row(w * 3);
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            auto pixel = pixels[x + y * w];
+            row[x * 3] = (pixel >> 16) & 0xFF;
+            row[x * 3 + 1] = (pixel >> 8) & 0xFF;
+            row[x * 3 + 2] = pixel & 0xFF;
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+// PNG编码交给SDL_image，surface只是包装一下已有的内存，不需要视频子系统
+bool WritePNG(const std::string &filename, std::span<const uint32_t> pixels,
+              uint32_t w, uint32_t h) {
+    auto surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        (void *)pixels.data(), w, h, 32, w * sizeof(uint32_t),
+        FRAMEBUFFER_FORMAT);
+    if (!surface) {
+        SDL_Log("Create Surface failed: %s", SDL_GetError());
+        return false;
+    }
+    bool ok = IMG_SavePNG(surface, filename.c_str()) == 0;
+    if (!ok) {
+        SDL_Log("save %s failed: %s", filename.c_str(), IMG_GetError());
+    }
+    SDL_FreeSurface(surface);
+    return ok;
+}
+
+// 用SDL_image读回PNG，像素转成FRAMEBUFFER_FORMAT；读不了时返回false
+bool ReadPNG(const std::string &filename, std::vector<uint32_t> &pixels,
+             uint32_t &w, uint32_t &h) {
+    auto loaded = IMG_Load(filename.c_str());
+    if (!loaded) {
+        return false;
+    }
+    auto surface = SDL_ConvertSurfaceFormat(loaded, FRAMEBUFFER_FORMAT, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) {
+        return false;
+    }
+    w = surface->w;
+    h = surface->h;
+    pixels.resize(size_t(w) * h);
+    for (uint32_t y = 0; y < h; y++) {
+        memcpy(pixels.data() + size_t(y) * w,
+               (const uint8_t *)surface->pixels + size_t(y) * surface->pitch,
+               w * sizeof(uint32_t));
+    }
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+// 按扩展名选择格式，目前支持.ppm和.png
+bool WriteFrame(const std::string &filename, std::span<const uint32_t> pixels,
+                uint32_t w, uint32_t h) {
+    auto ends = [&](const char *ext) {
+        std::string e = ext;
+        return filename.size() >= e.size() &&
+               filename.compare(filename.size() - e.size(), e.size(), e) == 0;
+    };
+    if (ends(".png")) {
+        return WritePNG(filename, pixels, w, h);
+    }
+    return WritePPM(filename, pixels, w, h);
+}
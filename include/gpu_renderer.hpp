@@ -1,10 +1,15 @@
 #pragma once
 #include "base_renderer.hpp"
+#include "frame_arena.hpp"
 #include "math.hpp"
 
-Attributes GetCorrectedAttribute(float z, std::vector<Vertex> vertices,
+Attributes GetCorrectedAttribute(float z, std::span<const Vertex> vertices,
                                  Barycentric &barycentric);
 
+// 自适应光栅化时屏幕空间面积(像素)不小于这个值的三角形改用扫描线：
+// 小三角形梯形拆分的开销比遍历包围盒大，大三角形包围盒里一半左右的像素是空的
+constexpr float SCANLINE_MIN_TRIANGLE_AREA = 256.0f;
+
 class GpuRenderer : public IRenderer {
    private:
     ColorAttachment colorAttachment_;
@@ -16,49 +21,75 @@ class GpuRenderer : public IRenderer {
     FrontFace frontFace_;
     FaceCull cull_;
     bool enableFramework_;
+    // 按三角形大小在包围盒遍历和扫描线之间选择
+    bool adaptiveRaster_;
 
-    void rasterizeTriangle(Mat44 &model, std::vector<Vertex> &vertices,
-                           TextureStorage &textureStorage) {
-        // call vertex changing function to change vertex position and set
-        // attribtues
-        for (auto &v : vertices) {
-            v = shader_.CallVertexChanging(v, uniforms_, textureStorage);
-        }
-        // Model and View transform
-        for (auto &v : vertices) {
-            v.position = camera_.view_mat_ * model * v.position;
-        }
-
-        std::vector<Vec3> positions;
-        std::transform(vertices.begin(), vertices.end(),
-                       std::back_inserter(positions),
-                       [](Vertex v) { return v.position.TruncatedToVec3(); });
+    // 顶点阶段的结果，按顶点下标存放，在帧之间复用
+    std::vector<Vertex> shadedVertices_;
+    Vec4Stream viewPositions_;
+    Vec4Stream screenPositions_;
+    // 每帧的临时数据，Clear时重置
+    FrameArena frameArena_;
+    // 当前绘制中通过背面剔除的三角形，存第一个顶点的下标，内存来自frameArena_
+    std::span<uint32_t> visibleTriangles_;
+    SharedPipelineStats stats_;
+    // 调试热力图的计数，只在打开时记录
+    PixelCostBuffer pixelCost_;
+    HeatmapMode heatmap_ = HeatmapMode::Off;
 
-        // face cull
-        if (ShouldCull(positions, camera_.view_dir_, frontFace_, cull_)) {
-            return;
-        }
+    // 整个mesh的顶点一起变换：view空间的位置用于背面剔除，
+    // 屏幕空间的位置用于光栅化；顶点多时分成几段在任务线程上处理
+    void processVertices(Mat44 &model, std::span<const Vertex> vertices,
+                         const TextureStorage &textureStorage) {
+        TRACE_ZONE("vertex processing");
+        auto count = vertices.size();
+        shadedVertices_.assign(vertices.begin(), vertices.end());
+        viewPositions_.Resize(count);
+        screenPositions_.Resize(count);
+        // Model and View transform
+        auto modelView = camera_.view_mat_ * model;
+        // project transform, perspective divide and viewport transform
+        // 这里w=-z，保存的深度就是真实的z
+        auto mapping = ScreenMapping::FromViewport(
+            viewport_.x, viewport_.y, viewport_.w, viewport_.h, 1.0f);
+        JobSystem::Global().ParallelFor(
+            0, count, VERTEX_JOB_GRAIN, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    // call vertex changing function to change vertex position
+                    // and set attribtues
+                    auto &v = shadedVertices_[i];
+                    v = shader_.CallVertexChanging(v, uniforms_,
+                                                   textureStorage);
+                    viewPositions_.Set(i, v.position);
+                }
+                auto view = viewPositions_.View().Offset(first);
+                auto screen = screenPositions_.View().Offset(first);
+                TransformPoints(modelView, view, view, last - first);
+                ProjectToScreen(camera_.frustum_.mat, mapping, view, screen,
+                                last - first);
+            });
+    }
 
+    // 整个三角形都在近平面前面，投影没有翻转，才能交给扫描线
+    bool preferScanline(std::span<const Vertex> vertices) const {
         for (auto &v : vertices) {
-            // project transform
-            v.position = camera_.frustum_.mat * v.position;
-            // save truely z
-            // 这里w=z，所以不需要动
-            v.position.z = -v.position.w;
-
-            // perspective divide
-            v.position.x /= v.position.w;
-            v.position.y /= v.position.w;
-            v.position.w = 1.0;
-
-            // Viewport transform
-            v.position.x =
-                (v.position.x + 1.0) * 0.5 * (viewport_.w - 1.0) + viewport_.x;
-            v.position.y = viewport_.h -
-                           (v.position.y + 1.0) * 0.5 * (viewport_.h - 1.0) +
-                           viewport_.y;
+            if (v.position.z > -camera_.frustum_.near) {
+                return false;
+            }
         }
+        auto &p0 = vertices[0].position;
+        auto &p1 = vertices[1].position;
+        auto &p2 = vertices[2].position;
+        auto area = Cross(Vec2{p1.x - p0.x, p1.y - p0.y},
+                          Vec2{p2.x - p0.x, p2.y - p0.y});
+        return std::abs(area) * 0.5f >= SCANLINE_MIN_TRIANGLE_AREA;
+    }
 
+    // vertices已经在屏幕空间，只画[rowBegin, rowEnd)之间的行
+    void rasterizeTriangle(std::span<const Vertex> vertices,
+                           const TextureStorage &textureStorage,
+                           uint32_t rowBegin, uint32_t rowEnd,
+                           PipelineStats &stats) {
         // find AABB for triangle
         auto aabbMinX = FLT_MAX;
         auto aabbMaxX = -FLT_MAX;
@@ -71,9 +102,9 @@ class GpuRenderer : public IRenderer {
             aabbMaxY = std::max(aabbMaxY, v.position.y);
         }
         aabbMinX = std::max(aabbMinX, 0.0f);
-        aabbMinY = std::max(aabbMinY, 0.0f);
+        aabbMinY = std::max(aabbMinY, rowBegin * 1.0f);
         aabbMaxX = std::min(aabbMaxX, colorAttachment_.width - 1.0f);
-        aabbMaxY = std::min(aabbMaxY, colorAttachment_.height - 1.0f);
+        aabbMaxY = std::min(aabbMaxY, rowEnd - 1.0f);
         Vec2 aabbMax = Vec2{aabbMaxX, aabbMaxY};
         Vec2 aabbMin = Vec2{aabbMinX, aabbMinY};
         if (enableFramework_) {
@@ -86,13 +117,24 @@ class GpuRenderer : public IRenderer {
                 Line line = Line{v1, v2};
                 RasterizeLine(line, shader_.pixelShading, uniforms_,
                               textureStorage, colorAttachment_,
-                              depthAttachment_);
+                              depthAttachment_, stats, pixelCost_);
+            }
+        } else if (adaptiveRaster_ && preferScanline(vertices)) {
+            auto [trap1Opt, trap2Opt] = Trapezoid::FromTriangle(vertices);
+            for (auto *trap : {&trap1Opt, &trap2Opt}) {
+                if (trap->has_value()) {
+                    RasterizeTrapezoid(trap->value(), shader_.pixelShading,
+                                       uniforms_, textureStorage,
+                                       colorAttachment_, depthAttachment_,
+                                       stats, pixelCost_, rowBegin, rowEnd);
+                }
             }
         } else {
             // walk through all pixel in AABB and set color
             // 这里循环中x和y不能用auto
             for (int x = aabbMin.x; x <= aabbMax.x; x++) {
                 for (int y = aabbMin.y; y <= aabbMax.y; y++) {
+                    PixelCostTimer timer(pixelCost_, x, y);
                     auto barycentric = Barycentric(
                         Vec2{x * 1.0f, y * 1.0f},
                         std::array<Vec2, 3>{Vec2{vertices[0].position.x,
@@ -108,15 +150,24 @@ class GpuRenderer : public IRenderer {
                                     barycentric.beta / vertices[1].position.z +
                                     barycentric.gamma / vertices[2].position.z;
                         auto z = 1.0f / invZ;
-                        // depth test and near plane
-                        if (z < camera_.frustum_.near &&
-                            depthAttachment_.Get(x, y) <= z) {
+                        // near plane
+                        if (z >= camera_.frustum_.near) {
+                            continue;
+                        }
+                        // depth test
+                        stats.pixelsDepthTested++;
+                        pixelCost_.CountDepthTest(x, y);
+                        if (depthAttachment_.Get(x, y) <= z) {
+                            stats.pixelsDepthPassed++;
                             auto attr =
                                 GetCorrectedAttribute(z, vertices, barycentric);
+                            stats.pixelsShaded++;
+                            pixelCost_.CountShade(x, y);
                             auto color = shader_.CallPixelShading(
                                 attr, uniforms_, textureStorage);
                             colorAttachment_.Set(x, y, color);
                             depthAttachment_.Set(x, y, z);
+                            pixelCost_.CountWrite(x, y);
                         }
                     }
                 }
@@ -124,10 +175,40 @@ class GpuRenderer : public IRenderer {
         }
     }
 
+    void rasterizeRows(uint32_t rowBegin, uint32_t rowEnd,
+                       const TextureStorage &textureStorage) {
+        TRACE_ZONE("raster band");
+        // 在局部变量里计数，画完这些行再合并
+        PipelineStats stats;
+        Triangle triangle;
+        for (auto first : visibleTriangles_) {
+            auto minY = FLT_MAX;
+            auto maxY = -FLT_MAX;
+            for (size_t k = 0; k < 3; k++) {
+                auto y = screenPositions_.Get(first + k).y;
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+            }
+            if (maxY < rowBegin || minY >= rowEnd) {
+                continue;
+            }
+            triangle.clear();
+            for (size_t k = 0; k < 3; k++) {
+                triangle.push_back(shadedVertices_[first + k]);
+                triangle.back().position = screenPositions_.Get(first + k);
+            }
+            rasterizeTriangle(triangle, textureStorage, rowBegin, rowEnd,
+                              stats);
+        }
+        stats_.Merge(stats);
+    }
+
    public:
     GpuRenderer(GpuRenderer &r) = default;
 
-    GpuRenderer(uint32_t w, uint32_t h, Camera camera)
+    // adaptiveRaster为true时大三角形用扫描线画
+    GpuRenderer(uint32_t w, uint32_t h, Camera camera,
+                bool adaptiveRaster = false)
         : colorAttachment_(ColorAttachment{w, h}),
           depthAttachment_(DepthAttachment{w, h}),
           camera_(camera),
@@ -136,25 +217,65 @@ class GpuRenderer : public IRenderer {
           uniforms_(Uniforms{}),
           frontFace_(FrontFace::CW),
           cull_(FaceCull::None),
-          enableFramework_(false) {}
+          enableFramework_(false),
+          adaptiveRaster_(adaptiveRaster),
+          pixelCost_(w, h) {}
 
-    void Clear(Vec4 &color) override { colorAttachment_.Clear(color); }
+    void Clear(Vec4 &color) override {
+        TRACE_ZONE("clear");
+        colorAttachment_.Clear(color);
+        visibleTriangles_ = {};
+        frameArena_.Reset();
+        stats_.Reset();
+        pixelCost_.Clear();
+    }
 
     uint32_t GetCanvaWidth() override { return colorAttachment_.width; }
 
     uint32_t GetCanvaHeight() override { return colorAttachment_.height; }
 
-    std::vector<uint8_t> GetRenderedImage() override {
-        return colorAttachment_.data;
+    std::span<const uint32_t> GetRenderedImage() override {
+        pixelCost_.Render(heatmap_, colorAttachment_);
+        return colorAttachment_.Pixels();
     }
 
-    void DrawTriangle(Mat44 &model, std::vector<Vertex> &vertices,
-                      TextureStorage &textureStorage) override {
-        for (int i = 0; i < vertices.size() / 3; i++) {
-            std::vector<Vertex> vertices_ = std::vector<Vertex>{
-                vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2]};
-            rasterizeTriangle(model, vertices_, textureStorage);
+    void DrawTriangle(Mat44 &model, std::span<const Vertex> vertices,
+                      const TextureStorage &textureStorage) override {
+        processVertices(model, vertices, textureStorage);
+        std::array<Vec3, 3> positions;
+        auto visible = frameArena_.Allocate<uint32_t>(vertices.size() / 3);
+        size_t visibleCount = 0;
+        PipelineStats stats;
+        stats.verticesShaded = vertices.size();
+        stats.trianglesSubmitted = vertices.size() / 3;
+        for (size_t i = 0; i + 3 <= vertices.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                positions[k] = viewPositions_.GetVec3(i + k);
+            }
+            // face cull
+            if (ShouldCull(positions, camera_.view_dir_, frontFace_, cull_)) {
+                stats.trianglesBackfaceCulled++;
+                continue;
+            }
+            visible[visibleCount++] = i;
         }
+        visibleTriangles_ = visible.first(visibleCount);
+        stats_.Merge(stats);
+
+        auto height = colorAttachment_.height;
+        if (enableFramework_) {
+            // 线框不按行切分
+            rasterizeRows(0, height, textureStorage);
+            return;
+        }
+        // 每块按原来的顺序画所有三角形，结果和单线程完全一致
+        auto tiles = (height + RASTER_TILE_ROWS - 1) / RASTER_TILE_ROWS;
+        JobSystem::Global().ParallelFor(
+            0, tiles, 1, [&](size_t first, size_t last) {
+                rasterizeRows(first * RASTER_TILE_ROWS,
+                              std::min<size_t>(last * RASTER_TILE_ROWS, height),
+                              textureStorage);
+            });
     }
 
     Shader &GetShader() override { return shader_; }
@@ -183,13 +304,35 @@ class GpuRenderer : public IRenderer {
     void DisableFramework() override { enableFramework_ = false; }
 
     SDL_Surface *GetSurface() override {
+        pixelCost_.Render(heatmap_, colorAttachment_);
         return colorAttachment_.ConvertToSurface();
     }
 
     void ToggleFramework() override { enableFramework_ = !enableFramework_; }
+
+    void SetLazyClear(bool lazy) override {
+        colorAttachment_.SetLazyClear(lazy);
+        depthAttachment_.SetLazyClear(lazy);
+    }
+
+    PipelineStats GetStats() override {
+        auto stats = stats_.Get();
+        stats.canvasPixels =
+            uint64_t(colorAttachment_.width) * colorAttachment_.height;
+        return stats;
+    }
+
+    void ResetStats() override { stats_.Reset(); }
+
+    void SetHeatmapMode(HeatmapMode mode) override {
+        pixelCost_.SetActive(mode != HeatmapMode::Off);
+        heatmap_ = pixelCost_.Active() ? mode : HeatmapMode::Off;
+    }
+
+    HeatmapMode GetHeatmapMode() override { return heatmap_; }
 };
 
-Attributes GetCorrectedAttribute(float z, std::vector<Vertex> vertices,
+Attributes GetCorrectedAttribute(float z, std::span<const Vertex> vertices,
                                  Barycentric &barycentric) {
     Attributes attr = Attributes();
     for (int i = 0; i < attr.varyingFloat.size(); i++) {
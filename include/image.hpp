@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <iostream>
+#include <span>
 #include <vector>
 
 #include "SDL.h"
@@ -15,88 +17,266 @@ class PureElementImage {
         : data(data), width(width), height(height) {}
 };
 
+// 懒清屏的块大小为 (1 << CLEAR_TILE_SHIFT)^2 个像素
+constexpr uint32_t CLEAR_TILE_SHIFT = 5;
+constexpr uint32_t CLEAR_TILE_SIZE = 1 << CLEAR_TILE_SHIFT;
+
+// 懒清屏：Clear只把所有块标记为"待清除"，块在第一次写入或者整体读回时
+// 才真正填充清屏值，没有被绘制到的背景块不产生任何开销
+class TileClearState {
+   private:
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t tilesX_;
+    std::vector<uint8_t> pending_;
+    bool anyPending_ = false;
+
+   public:
+    TileClearState(uint32_t width, uint32_t height)
+        : width_(width),
+          height_(height),
+          tilesX_((width + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_SHIFT),
+          pending_(tilesX_ *
+                       ((height + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_SHIFT),
+                   0) {}
+
+    void MarkAll() {
+        std::fill(pending_.begin(), pending_.end(), 1);
+        anyPending_ = true;
+    }
+
+    bool IsPending(uint32_t x, uint32_t y) const {
+        return anyPending_ &&
+               pending_[(y >> CLEAR_TILE_SHIFT) * tilesX_ +
+                        (x >> CLEAR_TILE_SHIFT)];
+    }
+
+    // fill(x, y, count)按行填充一段连续像素
+    template <typename Fill>
+    void Resolve(uint32_t x, uint32_t y, Fill fill) {
+        auto tileX = x >> CLEAR_TILE_SHIFT;
+        auto tileY = y >> CLEAR_TILE_SHIFT;
+        resolveTile(tileX, tileY, fill);
+    }
+
+    template <typename Fill>
+    void ResolveAll(Fill fill) {
+        if (!anyPending_) {
+            return;
+        }
+        for (uint32_t i = 0; i < pending_.size(); i++) {
+            resolveTile(i % tilesX_, i / tilesX_, fill);
+        }
+        anyPending_ = false;
+    }
+
+    // 立即清屏时，之前遗留的标记全部作废
+    void Reset() {
+        if (anyPending_) {
+            std::fill(pending_.begin(), pending_.end(), 0);
+            anyPending_ = false;
+        }
+    }
+
+   private:
+    template <typename Fill>
+    void resolveTile(uint32_t tileX, uint32_t tileY, Fill &fill) {
+        auto &flag = pending_[tileY * tilesX_ + tileX];
+        if (!flag) {
+            return;
+        }
+        flag = 0;
+        uint32_t x0 = tileX << CLEAR_TILE_SHIFT;
+        uint32_t y0 = tileY << CLEAR_TILE_SHIFT;
+        uint32_t count = std::min(CLEAR_TILE_SIZE, width_ - x0);
+        uint32_t y1 = std::min(y0 + CLEAR_TILE_SIZE, height_);
+        for (uint32_t y = y0; y < y1; y++) {
+            fill(x0, y, count);
+        }
+    }
+};
+
+// 帧缓冲的像素格式，和显示端的原生32位格式一致，呈现时不需要再转换
+constexpr Uint32 FRAMEBUFFER_FORMAT = SDL_PIXELFORMAT_ARGB8888;
+
+// 把[0, 1]的颜色打包成一个ARGB8888像素
+inline uint32_t PackColor(const Vec4 &color) {
+    auto channel = [](float value) {
+        return (uint32_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+    };
+    return (channel(color.a) << 24) | (channel(color.r) << 16) |
+           (channel(color.g) << 8) | channel(color.b);
+}
+
+inline Vec4 UnpackColor(uint32_t pixel) {
+    constexpr float inv = 1.0f / 255.0f;
+    return Vec4{((pixel >> 16) & 0xFF) * inv, ((pixel >> 8) & 0xFF) * inv,
+                (pixel & 0xFF) * inv, (pixel >> 24) * inv};
+}
+
+// 颜色附件只保存一份像素数据，SDL_Surface直接包装这块内存
 template <>
 class PureElementImage<uint8_t> {
    private:
-    SDL_Surface *surface_;
+    SDL_Surface *surface_ = nullptr;
+    TileClearState tileClear_;
+    uint32_t clearPixel_ = 0;
+    bool lazyClear_ = false;
 
-    Uint32 *getPixel(int x, int y) const {
-        Uint8 *ptr = (Uint8 *)surface_->pixels;
-        return (Uint32 *)(ptr + y * surface_->pitch +
-                          x * surface_->format->BytesPerPixel);
+    void fillRow(uint32_t x, uint32_t y, uint32_t count) {
+        std::fill_n(data.begin() + (x + y * width), count, clearPixel_);
+    }
+
+    void resolveAll() {
+        tileClear_.ResolveAll([this](uint32_t x, uint32_t y, uint32_t count) {
+            fillRow(x, y, count);
+        });
     }
 
    public:
-    std::vector<uint8_t> data;
+    std::vector<uint32_t> data;
     uint32_t width;
     uint32_t height;
 
-    PureElementImage(std::vector<uint8_t> data, uint32_t width, uint32_t height)
-        : data(data), width(width), height(height) {
-        surface_ = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
-                                                  SDL_PIXELFORMAT_RGBA32);
-        if (!surface_) {
-            SDL_Log("Create Surface failed: %s", SDL_GetError());
-        }
-    }
+    PureElementImage(std::vector<uint32_t> data, uint32_t width,
+                     uint32_t height)
+        : tileClear_(width, height),
+          data(data),
+          width(width),
+          height(height) {}
 
     PureElementImage(uint32_t w, uint32_t h)
-        : PureElementImage<uint8_t>(std::vector<uint8_t>(w * h * 4, 0), w, h) {}
+        : PureElementImage<uint8_t>(std::vector<uint32_t>(w * h, 0), w, h) {}
 
     PureElementImage(const PureElementImage &) = delete;
 
-    ~PureElementImage() { SDL_FreeSurface(surface_); }
+    ~PureElementImage() {
+        if (surface_) {
+            SDL_FreeSurface(surface_);
+        }
+    }
+
+    void Set(uint32_t x, uint32_t y, const Vec4 &color) {
+        if (tileClear_.IsPending(x, y)) {
+            tileClear_.Resolve(x, y,
+                               [this](uint32_t x, uint32_t y, uint32_t count) {
+                                   fillRow(x, y, count);
+                               });
+        }
+        data[x + y * width] = PackColor(color);
+    }
 
-    void Set(uint32_t x, uint32_t y, Vec4 &color) {
-        data[(x + y * width) * 4] = color.r * 255.0;
-        data[(x + y * width) * 4 + 1] = color.g * 255.0;
-        data[(x + y * width) * 4 + 2] = color.b * 255.0;
-        data[(x + y * width) * 4 + 3] = color.a * 255.0;
-        *getPixel(x, y) =
-            SDL_MapRGBA(surface_->format, color.r * 255.0, color.g * 255.0,
-                        color.b * 255.0, color.a * 255.0);
+    uint32_t Get(uint32_t x, uint32_t y) const {
+        return tileClear_.IsPending(x, y) ? clearPixel_ : data[x + y * width];
     }
 
-    void Clear(Vec4 &color) {
-        for (int i = 0; i < width; i++) {
-            for (int j = 0; j < height; j++) {
-                Set(i, j, color);
-            }
+    // 开启后Clear只做标记，真正的填充推迟到块第一次被写入或读回
+    void SetLazyClear(bool lazy) {
+        if (!lazy) {
+            resolveAll();
+        }
+        lazyClear_ = lazy;
+    }
+
+    void Clear(const Vec4 &color) {
+        clearPixel_ = PackColor(color);
+        if (lazyClear_) {
+            tileClear_.MarkAll();
+        } else {
+            tileClear_.Reset();
+            // 按行连续填充，编译器会生成向量化的写入
+            std::fill(data.begin(), data.end(), clearPixel_);
         }
-        SDL_FillRect(surface_, nullptr,
-                     SDL_MapRGBA(surface_->format, color.r * 255, color.g * 255,
-                                 color.b * 255, color.a * 255));
     }
 
-    SDL_Surface *ConvertToSurface() { return surface_; }
+    // 只读访问，不拷贝
+    std::span<const uint32_t> Pixels() {
+        resolveAll();
+        return data;
+    }
+
+    // surface在第一次使用时创建，之后一直指向data
+    SDL_Surface *ConvertToSurface() {
+        resolveAll();
+        if (!surface_) {
+            surface_ = SDL_CreateRGBSurfaceWithFormatFrom(
+                data.data(), width, height, 32, width * sizeof(uint32_t),
+                FRAMEBUFFER_FORMAT);
+            if (!surface_) {
+                SDL_Log("Create Surface failed: %s", SDL_GetError());
+            }
+        }
+        return surface_;
+    }
 };
 
 template <>
 class PureElementImage<float> {
+   private:
+    TileClearState tileClear_;
+    float clearValue_ = FLT_MIN;
+    bool lazyClear_ = false;
+
+    void fillRow(uint32_t x, uint32_t y, uint32_t count) {
+        std::fill_n(data.begin() + (x + y * width), count, clearValue_);
+    }
+
+    void resolveAll() {
+        tileClear_.ResolveAll([this](uint32_t x, uint32_t y, uint32_t count) {
+            fillRow(x, y, count);
+        });
+    }
+
    public:
     std::vector<float> data;
     uint32_t width;
     uint32_t height;
 
     PureElementImage(std::vector<float> data, uint32_t width, uint32_t height)
-        : data(data), width(width), height(height) {}
+        : tileClear_(width, height),
+          data(data),
+          width(width),
+          height(height) {}
 
     PureElementImage(uint32_t w, uint32_t h)
         : PureElementImage(std::vector<float>(w * h, FLT_MIN), w, h) {}
 
     void Set(uint32_t x, uint32_t y, float value) {
+        if (tileClear_.IsPending(x, y)) {
+            tileClear_.Resolve(x, y,
+                               [this](uint32_t x, uint32_t y, uint32_t count) {
+                                   fillRow(x, y, count);
+                               });
+        }
         data[x + y * width] = value;
     }
 
-    float Get(uint32_t x, uint32_t y) { return data[x + y * width]; }
+    // 读取不需要填充整块，直接返回清除值
+    float Get(uint32_t x, uint32_t y) const {
+        return tileClear_.IsPending(x, y) ? clearValue_ : data[x + y * width];
+    }
+
+    void SetLazyClear(bool lazy) {
+        if (!lazy) {
+            resolveAll();
+        }
+        lazyClear_ = lazy;
+    }
 
     void Clear(float value) {
-        for (int i = 0; i < width; i++) {
-            for (int j = 0; j < height; j++) {
-                Set(i, j, value);
-            }
+        clearValue_ = value;
+        if (lazyClear_) {
+            tileClear_.MarkAll();
+        } else {
+            tileClear_.Reset();
+            std::fill(data.begin(), data.end(), value);
         }
     }
+
+    std::span<const float> Values() {
+        resolveAll();
+        return data;
+    }
 };
 
 typedef PureElementImage<uint8_t> ColorAttachment;
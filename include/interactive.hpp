@@ -1,15 +1,88 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "SDL.h"
 #include "SDL_image.h"
 #include "SDL_ttf.h"
+#include "frame_writer.hpp"
+#include "image.hpp"
+#include "output_sink.hpp"
+#include "pipeline_stats.hpp"
+#include "trace.hpp"
+
+struct AppConfig {
+    // 在单独的线程上呈现，渲染下一帧和呈现上一帧可以重叠
+    bool presentThread = false;
+    // 无窗口模式：不初始化SDL视频子系统，渲染固定帧数后退出
+    bool headless = false;
+    uint32_t headlessFrames = 300;
+    // 无窗口模式下帧的输出目录，为空时只统计吞吐量
+    std::string outputDir;
+    // ppm 或 png
+    std::string outputFormat = "ppm";
+    // 视频流输出：y4m 或 rgb，为空时关闭；streamOutput为"-"时写到标准输出
+    std::string streamFormat;
+    std::string streamOutput = "-";
+    uint32_t streamFps = 30;
+    // 写入跟不上时丢帧而不是等待
+    bool streamDropFrames = false;
+    // 在标题栏显示管线统计
+    bool showStats = false;
+    // 每帧的管线统计写成CSV，为空时不写
+    std::string statsCsv;
+};
 
 class App {
    public:
-    App(const char* title, int w, int h) : title_(title) {
+    App(const char* title, int w, int h, AppConfig config = AppConfig{})
+        : title_(title), config_(config) {
+        if (!config_.streamFormat.empty()) {
+            auto sink = CreateOutputSink(config_.streamFormat,
+                                         config_.streamOutput,
+                                         config_.streamFps);
+            if (sink) {
+                streamWriter_ = std::make_unique<AsyncFrameWriter>(
+                    std::move(sink), STREAM_RING_SIZE,
+                    config_.streamDropFrames
+                        ? AsyncFrameWriter::OverflowPolicy::DropFrame
+                        : AsyncFrameWriter::OverflowPolicy::Block);
+            }
+        }
+        if (!config_.statsCsv.empty()) {
+            statsFile_ = fopen(config_.statsCsv.c_str(), "w");
+            if (statsFile_) {
+                fprintf(statsFile_, "%s\n", PipelineStats::CsvHeader());
+            } else {
+                SDL_Log("can't open %s", config_.statsCsv.c_str());
+            }
+        }
+        if (config_.headless) {
+            // 只需要SDL_image加载纹理
+            SDL_Init(0);
+            if (IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG) == 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_SYSTEM,
+                             "SDL_image init failed: ", IMG_GetError());
+            }
+            if (!config_.outputDir.empty()) {
+                std::filesystem::create_directories(config_.outputDir);
+            }
+            SDL_Log("headless init OK");
+            return;
+        }
         SDL_Init(SDL_INIT_EVERYTHING);
         if (TTF_Init() != 0) {
             SDL_LogError(SDL_LOG_CATEGORY_SYSTEM,
@@ -29,15 +102,43 @@ class App {
         if (!window_) {
             SDL_Log("can't create window");
         }
-        renderer_ = SDL_CreateRenderer(window_, -1, 0);
-        if (!renderer_) {
-            SDL_Log("can't create SDL renderer");
+        // SDL_Renderer只能在创建它的线程上使用
+        if (config_.presentThread) {
+            presentThread_ = std::thread([this]() { presentLoop(); });
+        } else {
+            createRenderer();
         }
         SDL_Log("SDL init OK");
     }
 
     virtual ~App() {
-        SDL_DestroyRenderer(renderer_);
+        if (statsFile_) {
+            fclose(statsFile_);
+        }
+        // 等写线程把队列里的帧写完
+        if (streamWriter_) {
+            auto dropped = streamWriter_->DroppedFrames();
+            streamWriter_.reset();
+            if (dropped > 0) {
+                SDL_Log("stream output dropped %llu frames",
+                        (unsigned long long)dropped);
+            }
+        }
+        if (config_.headless) {
+            IMG_Quit();
+            SDL_Quit();
+            return;
+        }
+        if (presentThread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(presentMutex_);
+                stopPresent_ = true;
+            }
+            presentCond_.notify_all();
+            presentThread_.join();
+        } else {
+            destroyRenderer();
+        }
         SDL_DestroyWindow(window_);
         IMG_Quit();
         TTF_CloseFont(font_);
@@ -46,8 +147,12 @@ class App {
     }
 
     void Run() {
+        if (config_.headless) {
+            runHeadless();
+            return;
+        }
         OnInit();
-        auto t = std::chrono::high_resolution_clock::now();
+        auto t = std::chrono::steady_clock::now();
         SDL_Log("start app");
         while (!ShouldExit()) {
             SDL_Event event;
@@ -76,44 +181,61 @@ class App {
                     }
                 }
             }
-            auto elapse = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::high_resolution_clock::now() - t);
-            t = std::chrono::high_resolution_clock::now();
-            SDL_SetWindowTitle(window_,
-                               (title_ + "fps: " +
-                                std::to_string(int(1000.0 / elapse.count())))
-                                   .c_str());
+            // 用秒为单位的浮点数，帧时间不到1毫秒时也不会除以0
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapse = now - t;
+            t = now;
+            char fps[32];
+            snprintf(fps, sizeof(fps), "fps: %.1f",
+                     elapse.count() > 0.0 ? 1.0 / elapse.count() : 0.0);
+            auto title = title_ + fps;
+            if (config_.showStats && lastStats_) {
+                title += "  " + lastStats_->Summary();
+            }
+            SDL_SetWindowTitle(window_, title.c_str());
+            TRACE_ZONE("frame");
             OnRender();
+            recordStats();
         }
         OnQuit();
     }
 
     void Exit() { isQuit_ = true; }
     bool ShouldExit() const { return isQuit_; }
+    bool IsHeadless() const { return config_.headless; }
 
     SDL_Window* GetWindow() const { return window_; }
 
-    void SwapBuffer(SDL_Surface* surface, std::string text = "") {
-        SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer_, surface);
-        // 画面
-        if (!texture) {
-            SDL_Log("swap buffer failed");
-        } else {
-            SDL_RenderCopy(renderer_, texture, nullptr, nullptr);
-            SDL_DestroyTexture(texture);
+    // pixels的格式为FRAMEBUFFER_FORMAT
+    void SwapBuffer(std::span<const uint32_t> pixels, uint32_t w, uint32_t h,
+                    const std::string& text = "") {
+        if (streamWriter_) {
+            streamWriter_->Submit(pixels, w, h);
         }
-        // 文字
-        if (!text.empty()) {
-            auto textSurface =
-                TTF_RenderUTF8_Blended_Wrapped(font_, text.c_str(), {0, 0, 0, 255},600);
-            auto textTexture =
-                SDL_CreateTextureFromSurface(renderer_, textSurface);
-            SDL_Rect rect = {0, 0, textSurface->w, textSurface->h};
-            SDL_FreeSurface(textSurface);
-            SDL_RenderCopy(renderer_, textTexture, nullptr, &rect);
-            SDL_DestroyTexture(textTexture);
+        if (config_.headless) {
+            writeHeadlessFrame(pixels, w, h);
+            return;
         }
-        SDL_RenderPresent(renderer_);
+        if (!presentThread_.joinable()) {
+            presentFrame(pixels.data(), w, h, text);
+            return;
+        }
+        // 双缓冲：等上一帧被呈现线程取走，再写入不在呈现中的那个缓冲
+        std::unique_lock<std::mutex> lock(presentMutex_);
+        presentCond_.wait(lock, [this]() { return queuedFrame_ < 0; });
+        int index = presentingFrame_ == 0 ? 1 : 0;
+        lock.unlock();
+
+        auto& frame = frames_[index];
+        frame.pixels.assign(pixels.begin(), pixels.end());
+        frame.w = w;
+        frame.h = h;
+        frame.text = text;
+
+        lock.lock();
+        queuedFrame_ = index;
+        lock.unlock();
+        presentCond_.notify_all();
     }
 
     void RenderText(std::string text, SDL_Rect* dstRect) {
@@ -134,10 +256,226 @@ class App {
     virtual void OnMotion(const SDL_MouseMotionEvent&) {}
     virtual void OnWindowResize(int, int) {}
 
+    // 最近一帧的管线统计，用于标题栏和CSV；没有统计时返回std::nullopt
+    virtual std::optional<PipelineStats> FrameStats() { return std::nullopt; }
+
    private:
+    struct TextTexture {
+        SDL_Texture* texture;
+        int w;
+        int h;
+    };
+
+    struct PendingFrame {
+        std::vector<uint32_t> pixels;
+        uint32_t w = 0;
+        uint32_t h = 0;
+        std::string text;
+    };
+
+    // 文字缓存超过这个数量就整体清空，防止每帧变化的文字无限增长
+    static constexpr size_t MAX_CACHED_TEXTS = 32;
+    // 视频流的缓冲帧数
+    static constexpr size_t STREAM_RING_SIZE = 4;
+
     bool isQuit_ = false;
-    SDL_Window* window_;
-    SDL_Renderer* renderer_;
-    TTF_Font* font_;
+    SDL_Window* window_ = nullptr;
+    SDL_Renderer* renderer_ = nullptr;
+    TTF_Font* font_ = nullptr;
     std::string title_;
+    AppConfig config_;
+    uint32_t frameIndex_ = 0;
+    std::unique_ptr<AsyncFrameWriter> streamWriter_;
+    FILE* statsFile_ = nullptr;
+    uint32_t statsFrame_ = 0;
+    std::optional<PipelineStats> lastStats_;
+
+    // 常驻的流式纹理，尺寸变化时才重新创建
+    SDL_Texture* frameTexture_ = nullptr;
+    uint32_t frameTextureW_ = 0;
+    uint32_t frameTextureH_ = 0;
+    std::unordered_map<std::string, TextTexture> textCache_;
+
+    std::thread presentThread_;
+    std::mutex presentMutex_;
+    std::condition_variable presentCond_;
+    std::array<PendingFrame, 2> frames_;
+    int queuedFrame_ = -1;
+    int presentingFrame_ = -1;
+    bool stopPresent_ = false;
+
+    void runHeadless() {
+        OnInit();
+        SDL_Log("start headless app, %u frames", config_.headlessFrames);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < config_.headlessFrames && !ShouldExit();
+             i++) {
+            TRACE_ZONE("frame");
+            OnRender();
+            recordStats();
+        }
+        std::chrono::duration<double> elapse =
+            std::chrono::high_resolution_clock::now() - start;
+        SDL_Log("rendered %u frames in %.3f s, %.2f fps, %.3f ms/frame",
+                frameIndex_, elapse.count(), frameIndex_ / elapse.count(),
+                elapse.count() * 1000.0 / std::max(frameIndex_, 1u));
+        if (config_.showStats && lastStats_) {
+            SDL_Log("last frame: %s", lastStats_->Summary().c_str());
+        }
+        OnQuit();
+    }
+
+    void writeHeadlessFrame(std::span<const uint32_t> pixels, uint32_t w,
+                            uint32_t h) {
+        TRACE_ZONE("write frame");
+        if (!config_.outputDir.empty()) {
+            char name[32];
+            snprintf(name, sizeof(name), "frame_%05u.%s", frameIndex_,
+                     config_.outputFormat.c_str());
+            WriteFrame((std::filesystem::path{config_.outputDir} / name)
+                           .string(),
+                       pixels, w, h);
+        }
+        frameIndex_++;
+    }
+
+    // 每帧渲染完调用：记下统计给标题栏用，打开了CSV时写一行
+    void recordStats() {
+        if (!config_.showStats && !statsFile_) {
+            return;
+        }
+        lastStats_ = FrameStats();
+        if (statsFile_ && lastStats_) {
+            lastStats_->WriteCsvRow(statsFile_, statsFrame_);
+        }
+        statsFrame_++;
+    }
+
+    void createRenderer() {
+        renderer_ = SDL_CreateRenderer(window_, -1, 0);
+        if (!renderer_) {
+            SDL_Log("can't create SDL renderer");
+        }
+    }
+
+    void destroyRenderer() {
+        clearTextCache();
+        if (frameTexture_) {
+            SDL_DestroyTexture(frameTexture_);
+            frameTexture_ = nullptr;
+        }
+        if (renderer_) {
+            SDL_DestroyRenderer(renderer_);
+            renderer_ = nullptr;
+        }
+    }
+
+    void clearTextCache() {
+        for (auto& [_, text] : textCache_) {
+            SDL_DestroyTexture(text.texture);
+        }
+        textCache_.clear();
+    }
+
+    bool uploadFrame(const uint32_t* pixels, uint32_t w, uint32_t h) {
+        if (!frameTexture_ || frameTextureW_ != w || frameTextureH_ != h) {
+            if (frameTexture_) {
+                SDL_DestroyTexture(frameTexture_);
+            }
+            frameTexture_ =
+                SDL_CreateTexture(renderer_, FRAMEBUFFER_FORMAT,
+                                  SDL_TEXTUREACCESS_STREAMING, w, h);
+            frameTextureW_ = w;
+            frameTextureH_ = h;
+            if (!frameTexture_) {
+                return false;
+            }
+        }
+        void* dst;
+        int pitch;
+        if (SDL_LockTexture(frameTexture_, nullptr, &dst, &pitch) == 0) {
+            auto rowBytes = w * sizeof(uint32_t);
+            if (pitch == (int)rowBytes) {
+                std::memcpy(dst, pixels, rowBytes * h);
+            } else {
+                for (uint32_t y = 0; y < h; y++) {
+                    std::memcpy((uint8_t*)dst + y * pitch, pixels + y * w,
+                                rowBytes);
+                }
+            }
+            SDL_UnlockTexture(frameTexture_);
+            return true;
+        }
+        return SDL_UpdateTexture(frameTexture_, nullptr, pixels,
+                                 w * sizeof(uint32_t)) == 0;
+    }
+
+    const TextTexture* getTextTexture(const std::string& text) {
+        auto it = textCache_.find(text);
+        if (it != textCache_.end()) {
+            return &it->second;
+        }
+        if (textCache_.size() >= MAX_CACHED_TEXTS) {
+            clearTextCache();
+        }
+        auto surface = TTF_RenderUTF8_Blended_Wrapped(font_, text.c_str(),
+                                                      {0, 0, 0, 255}, 600);
+        if (!surface) {
+            return nullptr;
+        }
+        auto texture = SDL_CreateTextureFromSurface(renderer_, surface);
+        TextTexture cached = TextTexture{texture, surface->w, surface->h};
+        SDL_FreeSurface(surface);
+        if (!texture) {
+            return nullptr;
+        }
+        return &textCache_.emplace(text, cached).first->second;
+    }
+
+    void presentFrame(const uint32_t* pixels, uint32_t w, uint32_t h,
+                      const std::string& text) {
+        TRACE_ZONE("present");
+        // 画面
+        if (!uploadFrame(pixels, w, h)) {
+            SDL_Log("swap buffer failed");
+        } else {
+            SDL_RenderCopy(renderer_, frameTexture_, nullptr, nullptr);
+        }
+        // 文字
+        if (!text.empty()) {
+            auto textTexture = getTextTexture(text);
+            if (textTexture) {
+                SDL_Rect rect = {0, 0, textTexture->w, textTexture->h};
+                SDL_RenderCopy(renderer_, textTexture->texture, nullptr,
+                               &rect);
+            }
+        }
+        SDL_RenderPresent(renderer_);
+    }
+
+    void presentLoop() {
+        trace::SetThreadName("present");
+        createRenderer();
+        std::unique_lock<std::mutex> lock(presentMutex_);
+        while (true) {
+            presentCond_.wait(lock, [this]() {
+                return queuedFrame_ >= 0 || stopPresent_;
+            });
+            if (queuedFrame_ < 0) {
+                break;
+            }
+            presentingFrame_ = queuedFrame_;
+            queuedFrame_ = -1;
+            lock.unlock();
+            presentCond_.notify_all();
+
+            auto& frame = frames_[presentingFrame_];
+            presentFrame(frame.pixels.data(), frame.w, frame.h, frame.text);
+
+            lock.lock();
+            presentingFrame_ = -1;
+        }
+        lock.unlock();
+        destroyRenderer();
+    }
 };
\ No newline at end of file
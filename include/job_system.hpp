@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+// 一组任务的计数器：提交时加一，任务执行完减一，Wait等到归零
+// 任务里可以再提交子任务并等待自己的计数器，形成父子关系
+class JobCounter {
+   public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool Done() const { return count_.load(std::memory_order_acquire) == 0; }
+
+   private:
+    friend class JobSystem;
+    std::atomic<uint32_t> count_{0};
+    // 还在队列里没被取走的任务数，在队列的锁里增减
+    std::atomic<uint32_t> queued_{0};
+    // 正在Wait这个计数器的线程数
+    std::atomic<uint32_t> waiters_{0};
+};
+
+// 工作窃取的任务调度器，加载、顶点处理和光栅化共用一组工作线程
+// 每个工作线程有自己的双端队列：自己从队尾取(后进先出，缓存友好)，
+// 空闲时从别的队列队头偷；不是工作线程的调用方提交的任务轮流放进各个队列
+// Wait在等待期间只执行属于所等计数器的任务：渲染线程等一帧的分块时
+// 不会捡到加载任务而卡住；所等的任务总能由等待方自己执行，嵌套等待不会死锁
+class JobSystem {
+   public:
+    using Job = std::function<void()>;
+
+    // workers为0时使用全部硬件线程
+    explicit JobSystem(uint32_t workers = 0) {
+        if (workers == 0) {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (uint32_t i = 0; i < workers; i++) {
+            queues_.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (uint32_t i = 0; i < workers; i++) {
+            threads_.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stopping_ = true;
+        }
+        sleepCond_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    uint32_t WorkerCount() const { return (uint32_t)threads_.size(); }
+
+    // 提交一个任务，counter不为空时任务完成后减一
+    void Run(Job job, JobCounter *counter = nullptr) {
+        if (counter) {
+            counter->count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto index = currentWorker();
+        if (index < 0) {
+            index = nextQueue_.fetch_add(1, std::memory_order_relaxed) %
+                    queues_.size();
+        }
+        // 先计数再入队，计数只会比队列里的任务多，不会少
+        queued_.fetch_add(1, std::memory_order_release);
+        {
+            auto &queue = *queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.PushBack(Task{std::move(job), counter});
+            if (counter) {
+                counter->queued_.fetch_add(1);
+            }
+        }
+        // 通常提交完才开始等，只有往正在被等待的计数器里追加任务时
+        // 才需要叫醒等待方；这时计数器一定还活着，刚提交的任务还没执行完
+        bool wakeWaiters = counter && counter->waiters_.load() > 0;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+        }
+        sleepCond_.notify_one();
+        if (wakeWaiters) {
+            waitCond_.notify_all();
+        }
+    }
+
+    // 等待counter归零，期间只执行属于counter的任务
+    // 队列里没有counter的任务时(都被别的线程取走了)不扫描队列，直接睡眠
+    void Wait(JobCounter &counter) {
+        Task task;
+        counter.waiters_.fetch_add(1);
+        while (!counter.Done()) {
+            if (counter.queued_.load() > 0 &&
+                takeTaskFor(counter, currentWorker(), task)) {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            waitCond_.wait(lock, [&]() {
+                return counter.Done() || counter.queued_.load() > 0;
+            });
+        }
+        counter.waiters_.fetch_sub(1);
+    }
+
+    // 把[begin, end)切成不小于grain的若干段并行执行body(first, last)，
+    // 返回时全部执行完；只有一段时直接在当前线程执行
+    template <typename Body>
+    void ParallelFor(size_t begin, size_t end, size_t grain, Body &&body) {
+        if (end <= begin) {
+            return;
+        }
+        auto count = end - begin;
+        grain = std::max<size_t>(grain, 1);
+        // 多切几段，工作线程之间可以互相偷来平衡负载
+        size_t maxChunks = (threads_.size() + 1) * 4;
+        auto chunks = std::min((count + grain - 1) / grain, maxChunks);
+        if (chunks <= 1) {
+            body(begin, end);
+            return;
+        }
+        auto step = (count + chunks - 1) / chunks;
+        chunks = (count + step - 1) / step;
+        auto runChunk = [&body, begin, end, step](size_t chunk) {
+            auto first = begin + chunk * step;
+            body(first, std::min(first + step, end));
+        };
+        JobCounter counter;
+        for (size_t chunk = 1; chunk < chunks; chunk++) {
+            // 只捕获两个字，std::function不用在堆上分配
+            Run([&runChunk, chunk]() { runChunk(chunk); }, &counter);
+        }
+        runChunk(0);
+        Wait(counter);
+    }
+
+    // 进程内共享的实例，第一次使用时创建
+    static JobSystem &Global() {
+        static JobSystem jobs(takeGlobalWorkerCount());
+        return jobs;
+    }
+
+    // 固定全局实例的工作线程数，0为全部硬件线程
+    // 必须在第一次调用Global之前设置，之后调用返回false
+    static bool SetGlobalWorkerCount(uint32_t workers) {
+        auto &state = globalState();
+        if (state.created.load()) {
+            return false;
+        }
+        state.workers = workers;
+        return true;
+    }
+
+   private:
+    struct Task {
+        Job job;
+        JobCounter *counter = nullptr;
+    };
+
+    // 环形缓冲区实现的双端队列，只在装满时扩容，稳定之后入队出队都不分配
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0;
+        size_t size = 0;
+
+        void PushBack(Task task) {
+            if (size == ring.size()) {
+                grow();
+            }
+            ring[(head + size) % ring.size()] = std::move(task);
+            size++;
+        }
+
+        void PopBack(Task &task) {
+            size--;
+            task = std::move(ring[(head + size) % ring.size()]);
+        }
+
+        void PopFront(Task &task) {
+            task = std::move(ring[head]);
+            head = (head + 1) % ring.size();
+            size--;
+        }
+
+        // 在队尾的limit个任务里取出属于counter的最靠后的一个，
+        // 它后面的任务依次前移
+        bool PopMatching(const JobCounter *counter, size_t limit,
+                         Task &task) {
+            auto end = size > limit ? size - limit : 0;
+            for (size_t i = size; i-- > end;) {
+                auto &slot = ring[(head + i) % ring.size()];
+                if (slot.counter != counter) {
+                    continue;
+                }
+                task = std::move(slot);
+                for (size_t k = i; k + 1 < size; k++) {
+                    ring[(head + k) % ring.size()] =
+                        std::move(ring[(head + k + 1) % ring.size()]);
+                }
+                size--;
+                return true;
+            }
+            return false;
+        }
+
+        void grow() {
+            std::vector<Task> bigger(std::max<size_t>(ring.size() * 2, 64));
+            for (size_t i = 0; i < size; i++) {
+                bigger[i] = std::move(ring[(head + i) % ring.size()]);
+            }
+            ring = std::move(bigger);
+            head = 0;
+        }
+    };
+
+    struct GlobalState {
+        uint32_t workers = 0;
+        std::atomic<bool> created{false};
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+    // 所有队列里的任务总数，用来决定是否睡眠
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> nextQueue_{0};
+    std::mutex sleepMutex_;
+    // 空闲的工作线程在sleepCond_上睡眠，Wait在waitCond_上睡眠
+    std::condition_variable sleepCond_;
+    std::condition_variable waitCond_;
+    bool stopping_ = false;
+
+    static GlobalState &globalState() {
+        static GlobalState state;
+        return state;
+    }
+
+    // 只在创建全局实例时调用一次
+    static uint32_t takeGlobalWorkerCount() {
+        auto &state = globalState();
+        state.created = true;
+        return state.workers;
+    }
+
+    // 当前线程在本调度器里的下标，不是本调度器的工作线程时为-1
+    int currentWorker() const {
+        return tlsOwner() == this ? tlsIndex() : -1;
+    }
+
+    static const JobSystem *&tlsOwner() {
+        static thread_local const JobSystem *owner = nullptr;
+        return owner;
+    }
+
+    static int &tlsIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // 先取自己队列的队尾，再从其他队列的队头偷
+    bool takeTask(int self, Task &task) {
+        if (queued_.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        if (self >= 0 && popBack(*queues_[self], task)) {
+            return true;
+        }
+        size_t count = queues_.size();
+        size_t start = self >= 0 ? self + 1 : 0;
+        for (size_t i = 0; i < count; i++) {
+            if (popFront(*queues_[(start + i) % count], task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 只取属于counter的任务，先找自己的队列
+    // 刚提交的任务在队尾，第一遍每个队列只看队尾的几个；
+    // 被后来提交的任务压到更深处时才整个扫描，保证总能取到，嵌套等待不会死锁
+    bool takeTaskFor(JobCounter &counter, int self, Task &task) {
+        const size_t SCAN_LIMIT = 16;
+        size_t count = queues_.size();
+        size_t start = self >= 0 ? self : 0;
+        for (size_t limit : {SCAN_LIMIT, SIZE_MAX}) {
+            for (size_t i = 0; i < count; i++) {
+                auto &queue = *queues_[(start + i) % count];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.PopMatching(&counter, limit, task)) {
+                    counter.queued_.fetch_sub(1);
+                    queued_.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            if (counter.queued_.load() == 0) {
+                break;
+            }
+        }
+        return false;
+    }
+
+    bool popBack(WorkerQueue &queue, Task &task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size == 0) {
+            return false;
+        }
+        queue.PopBack(task);
+        if (task.counter) {
+            task.counter->queued_.fetch_sub(1);
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool popFront(WorkerQueue &queue, Task &task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size == 0) {
+            return false;
+        }
+        queue.PopFront(task);
+        if (task.counter) {
+            task.counter->queued_.fetch_sub(1);
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void execute(Task &task) {
+        task.job();
+        task.job = nullptr;
+        if (task.counter &&
+            task.counter->count_.fetch_sub(1, std::memory_order_acq_rel) ==
+                1) {
+            // 唤醒可能在等这个计数器的线程
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+            }
+            waitCond_.notify_all();
+        }
+    }
+
+    void workerLoop(int index) {
+        tlsOwner() = this;
+        tlsIndex() = index;
+        trace::SetThreadName("job worker " + std::to_string(index));
+        Task task;
+        while (true) {
+            if (takeTask(index, task)) {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            sleepCond_.wait(lock, [this]() {
+                return stopping_ ||
+                       queued_.load(std::memory_order_acquire) > 0;
+            });
+            if (stopping_ && queued_.load(std::memory_order_acquire) == 0) {
+                break;
+            }
+        }
+    }
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 只读地把整个文件映射到内存，析构时解除映射
+class MappedFile {
+   public:
+    MappedFile() {}
+
+    explicit MappedFile(const std::filesystem::path &filename) {
+        Open(filename);
+    }
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            Close();
+            data_ = other.data_;
+            size_ = other.size_;
+            isOpen_ = other.isOpen_;
+#ifdef _WIN32
+            file_ = other.file_;
+            mapping_ = other.mapping_;
+            other.file_ = INVALID_HANDLE_VALUE;
+            other.mapping_ = nullptr;
+#endif
+            other.data_ = nullptr;
+            other.size_ = 0;
+            other.isOpen_ = false;
+        }
+        return *this;
+    }
+
+    bool Open(const std::filesystem::path &filename) {
+        Close();
+#ifdef _WIN32
+        file_ = CreateFileW(filename.wstring().c_str(), GENERIC_READ,
+                            FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            Close();
+            return false;
+        }
+        size_ = (size_t)size.QuadPart;
+        isOpen_ = true;
+        // 空文件不能建立映射
+        if (size_ == 0) {
+            return true;
+        }
+        mapping_ =
+            CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            Close();
+            return false;
+        }
+        data_ = (const uint8_t *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0,
+                                               0);
+        if (!data_) {
+            Close();
+            return false;
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        isOpen_ = true;
+        if (size_ > 0) {
+            auto data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                isOpen_ = false;
+                size_ = 0;
+                return false;
+            }
+            data_ = (const uint8_t *)data;
+            // 解析是顺序读取的
+            madvise(data, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+#endif
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (data_) {
+            munmap((void *)data_, size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        isOpen_ = false;
+    }
+
+    // 告诉系统[offset, offset + size)已经读完，可以从常驻内存中换出
+    // 顺序读取很大的文件时用来限制常驻内存
+    void Release(size_t offset, size_t size) {
+#ifndef _WIN32
+        auto page = (size_t)sysconf(_SC_PAGESIZE);
+        auto begin = (offset + page - 1) / page * page;
+        auto end = std::min(offset + size, size_) / page * page;
+        if (data_ && end > begin) {
+            madvise((void *)(data_ + begin), end - begin, MADV_DONTNEED);
+        }
+#endif
+    }
+
+    bool IsOpen() const { return isOpen_; }
+    const uint8_t *Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+    std::string_view View() const {
+        return std::string_view((const char *)data_, size_);
+    }
+
+   private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    bool isOpen_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
@@ -7,6 +7,10 @@
 #include <cmath>
 #include <initializer_list>
 #include <iostream>
+#include <span>
+#include <vector>
+
+#include "simd.hpp"
 /***************************
  * Log
  ****************************/
@@ -166,8 +170,9 @@ inline Vector<3> Cross(const Vector<3> &v1, const Vector<3> &v2) {
                      v1.x * v2.y - v1.y * v2.x};
 }
 
+// 16字节对齐，可以直接用SIMD加载
 template <>
-class Vector<4> {
+class alignas(16) Vector<4> {
    public:
     static const Vector One;
     static const Vector Zero;
@@ -397,6 +402,57 @@ Vector<Dim> Normalize(const Vector<Dim> &v) {
     return result;
 }
 
+// Vec4的SIMD版本，非模板的重载优先于上面的通用模板
+inline Vec4 operator+(const Vec4 &self, const Vec4 &o) {
+    Vec4 v;
+    simd::Store(v.data, simd::Add(simd::Load(self.data), simd::Load(o.data)));
+    return v;
+}
+
+inline Vec4 operator-(const Vec4 &self, const Vec4 &o) {
+    Vec4 v;
+    simd::Store(v.data, simd::Sub(simd::Load(self.data), simd::Load(o.data)));
+    return v;
+}
+
+inline Vec4 operator*(const Vec4 &self, const Vec4 &o) {
+    Vec4 v;
+    simd::Store(v.data, simd::Mul(simd::Load(self.data), simd::Load(o.data)));
+    return v;
+}
+
+inline Vec4 operator*(const Vec4 &self, real value) {
+    Vec4 v;
+    simd::Store(v.data,
+                simd::Mul(simd::Load(self.data), simd::Splat(value)));
+    return v;
+}
+
+inline Vec4 operator/(const Vec4 &self, real value) {
+    Vec4 v;
+    simd::Store(v.data,
+                simd::Div(simd::Load(self.data), simd::Splat(value)));
+    return v;
+}
+
+inline Vec4 &operator+=(Vec4 &self, const Vec4 &o) {
+    simd::Store(self.data,
+                simd::Add(simd::Load(self.data), simd::Load(o.data)));
+    return self;
+}
+
+inline Vec4 &operator-=(Vec4 &self, const Vec4 &o) {
+    simd::Store(self.data,
+                simd::Sub(simd::Load(self.data), simd::Load(o.data)));
+    return self;
+}
+
+inline Vec4 &operator*=(Vec4 &self, real value) {
+    simd::Store(self.data,
+                simd::Mul(simd::Load(self.data), simd::Splat(value)));
+    return self;
+}
+
 template <size_t Dim>
 std::ostream &operator<<(std::ostream &o, const Vector<Dim> &v) {
     o << "Vector<" << Dim << ">(";
@@ -455,6 +511,10 @@ class Matrix {
 
     void Set(size_t x, size_t y, real value) { data_[y + x * Row] = value; }
 
+    // 列主序的原始数据
+    real *Data() { return data_; }
+    const real *Data() const { return data_; }
+
     Matrix operator*(real value) const {
         Matrix result = *this;
         for (auto &elem : result.data_) {
@@ -518,18 +578,8 @@ class Matrix {
     Matrix &operator*=(const Matrix &m) {
         static_assert(Col == Row);
 
-        Matrix tmp;
-        for (size_t k = 0; k < Col; k++) {
-            for (size_t j = 0; j < Col; j++) {
-                real sum = 0;
-                for (size_t i = 0; i < Col; i++) {
-                    sum += Get(i, k) * m.Get(j, i);
-                }
-                tmp.Set(j, k, sum);
-            }
-        }
-
-        *this = tmp;
+        // Mat44会用到下面的SIMD版本
+        *this = *this * m;
         return *this;
     }
 
@@ -557,7 +607,8 @@ class Matrix {
     }
 
    private:
-    real data_[Col * Row];
+    // 4x4矩阵的每一列都16字节对齐
+    alignas(Col * Row == 16 ? 16 : alignof(real)) real data_[Col * Row];
 };
 
 template <size_t Col, size_t Row>
@@ -623,6 +674,249 @@ using Mat22 = Matrix<2, 2>;
 using Mat33 = Matrix<3, 3>;
 using Mat44 = Matrix<4, 4>;
 
+// Mat44的SIMD版本：结果的每一列是左矩阵各列的线性组合
+// 累加顺序和通用模板一致，没有FMA时结果逐位相同
+inline Mat44 operator*(const Mat44 &m1, const Mat44 &m2) {
+    auto c0 = simd::Load(m1.Data());
+    auto c1 = simd::Load(m1.Data() + 4);
+    auto c2 = simd::Load(m1.Data() + 8);
+    auto c3 = simd::Load(m1.Data() + 12);
+    Mat44 result;
+    for (size_t j = 0; j < 4; j++) {
+        auto col = simd::Load(m2.Data() + j * 4);
+        auto sum = simd::Mul(c0, simd::Lane<0>(col));
+        sum = simd::MulAdd(c1, simd::Lane<1>(col), sum);
+        sum = simd::MulAdd(c2, simd::Lane<2>(col), sum);
+        sum = simd::MulAdd(c3, simd::Lane<3>(col), sum);
+        simd::Store(result.Data() + j * 4, sum);
+    }
+    return result;
+}
+
+inline Vec4 operator*(const Mat44 &m, const Vec4 &v) {
+    auto vec = simd::Load(v.data);
+    auto sum = simd::Mul(simd::Load(m.Data()), simd::Lane<0>(vec));
+    sum = simd::MulAdd(simd::Load(m.Data() + 4), simd::Lane<1>(vec), sum);
+    sum = simd::MulAdd(simd::Load(m.Data() + 8), simd::Lane<2>(vec), sum);
+    sum = simd::MulAdd(simd::Load(m.Data() + 12), simd::Lane<3>(vec), sum);
+    Vec4 result;
+    simd::Store(result.data, sum);
+    return result;
+}
+
+/***************************
+ * 批量变换
+ ****************************/
+
+// 分量分开存放的Vec4数组(SoA)，批量kernel一次处理多个元素
+struct Vec4SoA {
+    float *x;
+    float *y;
+    float *z;
+    float *w;
+
+    // 从第i个元素开始的视图，用来把一批数据分给多个任务
+    Vec4SoA Offset(size_t i) const {
+        return Vec4SoA{x + i, y + i, z + i, w + i};
+    }
+};
+
+// 持有SoA数据的缓冲，在帧之间复用，容量只增不减
+class Vec4Stream {
+   public:
+    void Resize(size_t count) {
+        x_.resize(count);
+        y_.resize(count);
+        z_.resize(count);
+        w_.resize(count);
+    }
+
+    size_t Size() const { return x_.size(); }
+
+    Vec4SoA View() {
+        return Vec4SoA{x_.data(), y_.data(), z_.data(), w_.data()};
+    }
+
+    void Set(size_t i, const Vec4 &v) {
+        x_[i] = v.x;
+        y_[i] = v.y;
+        z_[i] = v.z;
+        w_[i] = v.w;
+    }
+
+    Vec4 Get(size_t i) const { return Vec4{x_[i], y_[i], z_[i], w_[i]}; }
+
+    Vec3 GetVec3(size_t i) const { return Vec3{x_[i], y_[i], z_[i]}; }
+
+   private:
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+    std::vector<float> w_;
+};
+
+// NDC的[-1, 1]到视口的映射(y轴向下)，以及投影后保存的深度 -w * depthScale
+struct ScreenMapping {
+    float scaleX;
+    float offsetX;
+    float scaleY;
+    float offsetY;
+    float depthScale;
+
+    static ScreenMapping FromViewport(float x, float y, float w, float h,
+                                      float depthScale) {
+        float sx = 0.5f * (w - 1.0f);
+        float sy = 0.5f * (h - 1.0f);
+        return ScreenMapping{sx, sx + x, -sy, h - sy + y, depthScale};
+    }
+
+    // 单个裁剪空间的点，和ProjectToScreen相同
+    Vec4 ToScreen(const Vec4 &clip) const {
+        return Vec4{clip.x / clip.w * scaleX + offsetX,
+                    clip.y / clip.w * scaleY + offsetY,
+                    -clip.w * depthScale, 1.0f};
+    }
+};
+
+// 一个宽度的kernel，从第i(<= count)个元素开始处理完整的组，
+// 返回没处理的第一个下标
+// out可以和in相同
+template <typename W>
+size_t TransformPointsLanes(const Mat44 &m, const Vec4SoA &in,
+                            const Vec4SoA &out, size_t i, size_t count) {
+    typename W::Type e[16];
+    for (size_t k = 0; k < 16; k++) {
+        e[k] = W::Splat(m.Data()[k]);
+    }
+    size_t end = count - (count - i) % W::WIDTH;
+    for (; i < end; i += W::WIDTH) {
+        auto x = W::Load(in.x + i);
+        auto y = W::Load(in.y + i);
+        auto z = W::Load(in.z + i);
+        auto w = W::Load(in.w + i);
+        typename W::Type result[4];
+        // 和Mat44 * Vec4相同的累加顺序
+        for (size_t r = 0; r < 4; r++) {
+            auto sum = simd::Mul(e[r], x);
+            sum = simd::MulAdd(e[4 + r], y, sum);
+            sum = simd::MulAdd(e[8 + r], z, sum);
+            result[r] = simd::MulAdd(e[12 + r], w, sum);
+        }
+        W::Store(out.x + i, result[0]);
+        W::Store(out.y + i, result[1]);
+        W::Store(out.z + i, result[2]);
+        W::Store(out.w + i, result[3]);
+    }
+    return i;
+}
+
+template <typename W>
+size_t ProjectToScreenLanes(const Mat44 &proj, const ScreenMapping &mapping,
+                            const Vec4SoA &in, const Vec4SoA &out, size_t i,
+                            size_t count) {
+    typename W::Type e[16];
+    for (size_t k = 0; k < 16; k++) {
+        e[k] = W::Splat(proj.Data()[k]);
+    }
+    auto scaleX = W::Splat(mapping.scaleX);
+    auto offsetX = W::Splat(mapping.offsetX);
+    auto scaleY = W::Splat(mapping.scaleY);
+    auto offsetY = W::Splat(mapping.offsetY);
+    auto depthScale = W::Splat(-mapping.depthScale);
+    auto one = W::Splat(1.0f);
+    size_t end = count - (count - i) % W::WIDTH;
+    for (; i < end; i += W::WIDTH) {
+        auto x = W::Load(in.x + i);
+        auto y = W::Load(in.y + i);
+        auto z = W::Load(in.z + i);
+        auto w = W::Load(in.w + i);
+        typename W::Type clip[4];
+        for (size_t r = 0; r < 4; r++) {
+            auto sum = simd::Mul(e[r], x);
+            sum = simd::MulAdd(e[4 + r], y, sum);
+            sum = simd::MulAdd(e[8 + r], z, sum);
+            clip[r] = simd::MulAdd(e[12 + r], w, sum);
+        }
+        // 透视除法和视口变换，深度保存投影前的真实z
+        auto sx = simd::Div(clip[0], clip[3]);
+        auto sy = simd::Div(clip[1], clip[3]);
+        W::Store(out.x + i, simd::MulAdd(sx, scaleX, offsetX));
+        W::Store(out.y + i, simd::MulAdd(sy, scaleY, offsetY));
+        W::Store(out.z + i, simd::Mul(clip[3], depthScale));
+        W::Store(out.w + i, one);
+    }
+    return i;
+}
+
+// 批量变换 out[i] = m * in[i]，out可以和in相同
+inline void TransformPoints(const Mat44 &m, const Vec4SoA &in,
+                            const Vec4SoA &out, size_t count) {
+    size_t i = 0;
+#ifdef SIMD_AVX
+    i = TransformPointsLanes<simd::Wide8>(m, in, out, i, count);
+#endif
+    i = TransformPointsLanes<simd::Wide4>(m, in, out, i, count);
+    TransformPointsLanes<simd::Wide1>(m, in, out, i, count);
+}
+
+// AoS版本，每个点一次4路乘法
+inline void TransformPoints(const Mat44 &m, std::span<const Vec4> in,
+                            std::span<Vec4> out) {
+    for (size_t i = 0; i < in.size(); i++) {
+        out[i] = m * in[i];
+    }
+}
+
+// 投影、透视除法和视口变换合在一遍里：
+// out.xy为屏幕坐标，out.z为 -clip.w * depthScale，out.w为1
+inline void ProjectToScreen(const Mat44 &proj, const ScreenMapping &mapping,
+                            const Vec4SoA &in, const Vec4SoA &out,
+                            size_t count) {
+    size_t i = 0;
+#ifdef SIMD_AVX
+    i = ProjectToScreenLanes<simd::Wide8>(proj, mapping, in, out, i, count);
+#endif
+    i = ProjectToScreenLanes<simd::Wide4>(proj, mapping, in, out, i, count);
+    ProjectToScreenLanes<simd::Wide1>(proj, mapping, in, out, i, count);
+}
+
+// 法线矩阵：左上3x3的逆转置，模型有非均匀缩放时法线仍然垂直于表面
+inline Mat33 NormalMatrix(const Mat44 &m) {
+    auto a = [&](size_t row, size_t col) { return m.Get(col, row); };
+    // 余子式矩阵除以行列式就是逆转置
+    real c00 = a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1);
+    real c01 = a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2);
+    real c02 = a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0);
+    real c10 = a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2);
+    real c11 = a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0);
+    real c12 = a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1);
+    real c20 = a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1);
+    real c21 = a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2);
+    real c22 = a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+    real det = a(0, 0) * c00 + a(0, 1) * c01 + a(0, 2) * c02;
+    real invDet = det != 0.0f ? 1.0f / det : 0.0f;
+    // clang-format off
+    return Mat33{
+        c00 * invDet, c01 * invDet, c02 * invDet,
+        c10 * invDet, c11 * invDet, c12 * invDet,
+        c20 * invDet, c21 * invDet, c22 * invDet,
+    };
+    // clang-format on
+}
+
+// 用模型矩阵的逆转置批量变换法线，结果不归一化
+inline void TransformNormals(const Mat44 &m, std::span<const Vec3> in,
+                             std::span<Vec3> out) {
+    auto n = NormalMatrix(m);
+    for (size_t i = 0; i < in.size(); i++) {
+        auto v = in[i];
+        out[i] = Vec3{
+            n.Get(0, 0) * v.x + n.Get(1, 0) * v.y + n.Get(2, 0) * v.z,
+            n.Get(0, 1) * v.x + n.Get(1, 1) * v.y + n.Get(2, 1) * v.z,
+            n.Get(0, 2) * v.x + n.Get(1, 2) * v.y + n.Get(2, 2) * v.z};
+    }
+}
+
 template <typename T>
 T Clamp(T value, T min, T max) {
     return std::min(std::max(value, min), max);
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "shader.hpp"
+
+// 二进制网格缓存
+// 保存展开后的顶点缓冲、每个mesh的材质绑定和包围盒，
+// 第一次加载OBJ后写在源文件旁边，之后直接映射到内存，
+// 顶点缓冲不经过解析和构造就可以绘制
+//
+// 布局(小端)：
+//   MeshCacheHeader
+//   Vertex[vertexCount]                   按MESH_CACHE_ALIGNMENT对齐
+//   MeshCacheDependency[dependencyCount]  OBJ和mtl文件，用于判断缓存是否过期
+//   MeshCacheMesh[meshCount]
+//   MeshCacheString[textureCount]         需要加载的纹理
+//   字符串
+// 顶点在前，加载OBJ时可以边解析边写入，不需要在内存中保留全部顶点
+
+const char MESH_CACHE_MAGIC[8] = {'S', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+// 文件格式或Vertex的布局改变时递增
+const uint32_t MESH_CACHE_VERSION = 2;
+const size_t MESH_CACHE_ALIGNMENT = 64;
+const char MESH_CACHE_EXTENSION[] = ".srmesh";
+
+static_assert(std::is_trivially_copyable_v<Vertex>,
+              "Vertex must be trivially copyable to be memory-mapped");
+static_assert(MESH_CACHE_ALIGNMENT % alignof(Vertex) == 0);
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t vertexAlignment;
+    uint32_t dependencyCount;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t tableOffset;
+    uint64_t stringOffset;
+    uint64_t stringSize;
+};
+
+struct MeshCacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// 文件不存在时size为MISSING_FILE_SIZE
+struct MeshCacheDependency {
+    static constexpr uint64_t MISSING_FILE_SIZE = ~0ull;
+
+    MeshCacheString path;  // 相对于缓存文件所在的目录
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;  // 为0时不比较
+};
+
+struct MeshCacheMesh {
+    enum Flags : uint32_t { HasColor = 1, HasTexture = 2 };
+
+    uint64_t firstVertex;
+    uint64_t vertexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    float color[4];
+    uint32_t flags;
+    uint32_t texture;  // textures中的下标
+};
+
+// 文件头、中间和末尾各取一段做FNV-1a，不需要读完整个大文件
+inline uint64_t SampledFileHash(const MappedFile &file) {
+    const size_t SAMPLE_SIZE = 64 << 10;
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](size_t offset, size_t size) {
+        auto data = file.Data() + offset;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+    };
+    auto size = file.Size();
+    if (size <= SAMPLE_SIZE * 3) {
+        mix(0, size);
+    } else {
+        mix(0, SAMPLE_SIZE);
+        mix(size / 2 - SAMPLE_SIZE / 2, SAMPLE_SIZE);
+        mix(size - SAMPLE_SIZE, SAMPLE_SIZE);
+    }
+    hash ^= size;
+    return hash == 0 ? 1 : hash;
+}
+
+// 文件的当前状态
+struct MeshCacheFileStat {
+    uint64_t size = MeshCacheDependency::MISSING_FILE_SIZE;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+};
+
+inline MeshCacheFileStat StatMeshCacheDependency(
+    const std::filesystem::path &path, bool withHash) {
+    MeshCacheFileStat stat;
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return stat;
+    }
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return stat;
+    }
+    stat.size = size;
+    stat.mtime = (int64_t)mtime.time_since_epoch().count();
+    if (withHash) {
+        MappedFile file;
+        if (!file.Open(path)) {
+            return MeshCacheFileStat{};
+        }
+        stat.hash = SampledFileHash(file);
+    }
+    return stat;
+}
+
+inline std::filesystem::path MeshCachePath(
+    const std::filesystem::path &source) {
+    auto path = source;
+    path += MESH_CACHE_EXTENSION;
+    return path;
+}
+
+constexpr size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// 和目标文件在同一目录下的临时文件名，带上进程号和进程内的计数，
+// 多个进程或线程同时生成同一个缓存时各写各的
+inline std::filesystem::path MeshCacheTemporaryPath(
+    const std::filesystem::path &path) {
+    static std::atomic<uint32_t> counter{0};
+#ifdef _WIN32
+    auto pid = (unsigned long)GetCurrentProcessId();
+#else
+    auto pid = (unsigned long)getpid();
+#endif
+    auto temporary = path;
+    temporary += "." + std::to_string(pid) + "." +
+                 std::to_string(counter.fetch_add(1)) + ".tmp";
+    return temporary;
+}
+
+// 边加载边写缓存：先写顶点，最后写表和文件头
+// 先写到临时文件再改名，其他进程不会读到写了一半的缓存
+class MeshCacheWriter {
+   public:
+    ~MeshCacheWriter() { Abort(); }
+
+    bool Begin(const std::filesystem::path &path) {
+        path_ = path;
+        temporary_ = MeshCacheTemporaryPath(path);
+        file_.open(temporary_, std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            return false;
+        }
+        // 文件头最后再写
+        char padding[vertexOffset()] = {};
+        file_.write(padding, sizeof(padding));
+        return (bool)file_;
+    }
+
+    // record中的firstVertex和vertexCount由这里填写
+    bool Append(MeshCacheMesh record, std::span<const Vertex> vertices) {
+        record.firstVertex = vertexCount_;
+        record.vertexCount = vertices.size();
+        file_.write((const char *)vertices.data(),
+                    sizeof(Vertex) * vertices.size());
+        vertexCount_ += vertices.size();
+        meshes_.push_back(record);
+        return (bool)file_;
+    }
+
+    // dependencies的第一个是OBJ本身，会同时记录hash
+    bool Finish(const std::vector<std::filesystem::path> &dependencyFiles,
+                const std::vector<std::string> &textureNames) {
+        auto directory = path_.parent_path().lexically_normal();
+        std::string strings;
+        auto addString = [&](const std::string &str) {
+            MeshCacheString ref{(uint32_t)strings.size(),
+                                (uint32_t)str.size()};
+            strings += str;
+            return ref;
+        };
+        std::vector<MeshCacheDependency> dependencies;
+        for (size_t i = 0; i < dependencyFiles.size(); i++) {
+            auto &dependency = dependencyFiles[i];
+            auto stat = StatMeshCacheDependency(dependency, i == 0);
+            auto relative =
+                dependency.lexically_normal().lexically_relative(directory);
+            dependencies.push_back(MeshCacheDependency{
+                addString(relative.generic_string()), stat.size, stat.mtime,
+                stat.hash});
+        }
+        std::vector<MeshCacheString> textures;
+        for (auto &texture : textureNames) {
+            textures.push_back(addString(texture));
+        }
+
+        MeshCacheHeader header = {};
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.vertexAlignment = MESH_CACHE_ALIGNMENT;
+        header.dependencyCount = dependencies.size();
+        header.meshCount = meshes_.size();
+        header.textureCount = textures.size();
+        header.vertexOffset = vertexOffset();
+        header.vertexCount = vertexCount_;
+        auto vertexEnd = header.vertexOffset + sizeof(Vertex) * vertexCount_;
+        header.tableOffset = AlignUp(vertexEnd, alignof(MeshCacheMesh));
+        header.stringOffset =
+            header.tableOffset +
+            sizeof(MeshCacheDependency) * dependencies.size() +
+            sizeof(MeshCacheMesh) * meshes_.size() +
+            sizeof(MeshCacheString) * textures.size();
+        header.stringSize = strings.size();
+
+        char padding[alignof(MeshCacheMesh)] = {};
+        file_.write(padding, header.tableOffset - vertexEnd);
+        file_.write((const char *)dependencies.data(),
+                    sizeof(MeshCacheDependency) * dependencies.size());
+        file_.write((const char *)meshes_.data(),
+                    sizeof(MeshCacheMesh) * meshes_.size());
+        file_.write((const char *)textures.data(),
+                    sizeof(MeshCacheString) * textures.size());
+        file_.write(strings.data(), strings.size());
+        file_.seekp(0);
+        file_.write((const char *)&header, sizeof(header));
+        file_.close();
+        if (!file_) {
+            Abort();
+            return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary_, path_, ec);
+        if (ec) {
+            Abort();
+            return false;
+        }
+        temporary_.clear();
+        return true;
+    }
+
+    // 放弃写入，删除临时文件
+    void Abort() {
+        if (file_.is_open()) {
+            file_.close();
+        }
+        if (!temporary_.empty()) {
+            std::error_code ec;
+            std::filesystem::remove(temporary_, ec);
+            temporary_.clear();
+        }
+    }
+
+   private:
+    std::filesystem::path path_;
+    std::filesystem::path temporary_;
+    std::ofstream file_;
+    std::vector<MeshCacheMesh> meshes_;
+    uint64_t vertexCount_ = 0;
+
+    static constexpr size_t vertexOffset() {
+        return AlignUp(sizeof(MeshCacheHeader), MESH_CACHE_ALIGNMENT);
+    }
+};
+
+// 映射到内存的缓存文件，所有访问都直接指向映射的内存
+class MeshCacheFile {
+   public:
+    // 文件不存在、格式不对或者依赖的文件有变化时返回false
+    bool Open(const std::filesystem::path &path) {
+        if (!file_.Open(path) || !validate(path.parent_path())) {
+            file_.Close();
+            header_ = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t MeshCount() const { return header_->meshCount; }
+
+    const MeshCacheMesh &Mesh(uint32_t i) const {
+        return ((const MeshCacheMesh *)(dependencies() +
+                                        header_->dependencyCount))[i];
+    }
+
+    std::span<const Vertex> Vertices(const MeshCacheMesh &mesh) const {
+        auto vertices =
+            (const Vertex *)(file_.Data() + header_->vertexOffset);
+        return std::span<const Vertex>(vertices + mesh.firstVertex,
+                                       mesh.vertexCount);
+    }
+
+    uint32_t TextureCount() const { return header_->textureCount; }
+
+    std::string_view Texture(uint32_t i) const {
+        return stringAt(textures()[i]);
+    }
+
+   private:
+    MappedFile file_;
+    const MeshCacheHeader *header_ = nullptr;
+
+    const MeshCacheDependency *dependencies() const {
+        return (const MeshCacheDependency *)(file_.Data() +
+                                             header_->tableOffset);
+    }
+
+    const MeshCacheString *textures() const {
+        return (const MeshCacheString *)(file_.Data() + header_->tableOffset +
+                                         sizeof(MeshCacheDependency) *
+                                             header_->dependencyCount +
+                                         sizeof(MeshCacheMesh) *
+                                             header_->meshCount);
+    }
+
+    std::string_view stringAt(const MeshCacheString &str) const {
+        return std::string_view(
+            (const char *)file_.Data() + header_->stringOffset + str.offset,
+            str.length);
+    }
+
+    bool validate(const std::filesystem::path &directory) {
+        if (file_.Size() < sizeof(MeshCacheHeader)) {
+            return false;
+        }
+        header_ = (const MeshCacheHeader *)file_.Data();
+        if (memcmp(header_->magic, MESH_CACHE_MAGIC, sizeof(header_->magic)) ||
+            header_->version != MESH_CACHE_VERSION ||
+            header_->vertexSize != sizeof(Vertex) ||
+            header_->vertexAlignment != MESH_CACHE_ALIGNMENT ||
+            header_->vertexOffset % MESH_CACHE_ALIGNMENT != 0) {
+            return false;
+        }
+        if (header_->vertexCount > file_.Size() / sizeof(Vertex)) {
+            return false;
+        }
+        auto vertexEnd =
+            header_->vertexOffset + header_->vertexCount * sizeof(Vertex);
+        auto tables =
+            sizeof(MeshCacheDependency) * header_->dependencyCount +
+            sizeof(MeshCacheMesh) * header_->meshCount +
+            sizeof(MeshCacheString) * header_->textureCount;
+        if (header_->vertexOffset < sizeof(MeshCacheHeader) ||
+            header_->tableOffset !=
+                AlignUp(vertexEnd, alignof(MeshCacheMesh)) ||
+            header_->stringOffset != header_->tableOffset + tables ||
+            header_->stringOffset + header_->stringSize != file_.Size()) {
+            return false;
+        }
+        auto inStrings = [&](const MeshCacheString &str) {
+            return (uint64_t)str.offset + str.length <= header_->stringSize;
+        };
+        for (uint32_t i = 0; i < header_->dependencyCount; i++) {
+            auto &dependency = dependencies()[i];
+            if (!inStrings(dependency.path)) {
+                return false;
+            }
+            auto stat = StatMeshCacheDependency(
+                directory / std::string(stringAt(dependency.path)),
+                dependency.hash != 0);
+            if (stat.size != dependency.size ||
+                stat.mtime != dependency.mtime ||
+                stat.hash != dependency.hash) {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < header_->meshCount; i++) {
+            auto &mesh = Mesh(i);
+            if (mesh.firstVertex + mesh.vertexCount > header_->vertexCount ||
+                ((mesh.flags & MeshCacheMesh::HasTexture) &&
+                 mesh.texture >= header_->textureCount)) {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < header_->textureCount; i++) {
+            if (!inStrings(textures()[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cassert>
+#include <filesystem>
+#include <functional>
 #include <tuple>
 #include <vector>
 
@@ -21,6 +23,9 @@ class Vertex {
           color(color) {}
 };
 
+// 流式加载时复用的顶点缓冲超过这个数量就释放
+const size_t MAX_RETAINED_MESH_VERTICES = 1 << 20;
+
 enum PreOperation {
     None = 0x00,
     RecalcNormal = 0x01,
@@ -40,26 +45,27 @@ class Mesh {
     //     {}
 };
 
-std::optional<std::tuple<std::vector<Mesh>, std::vector<objloader::Mtllib>>>
+// 返回mesh、材质库和引用到的mtl文件
+std::optional<std::tuple<std::vector<Mesh>, std::vector<objloader::Mtllib>,
+                         std::vector<std::filesystem::path>>>
 LoadFromFile(std::string&& filename, PreOperation preOperation) {
     std::vector<Mesh> meshes;
     auto sceneOpt = objloader::LoadFromFile(filename);
     if (sceneOpt.has_value()) {
         auto& scene = sceneOpt.value();
-        for (auto model : scene.models) {
+        for (auto& model : scene.models) {
             Mesh mesh = Mesh(model.name);
-            for (auto face : model.faces) {
-                for (auto vtx : face.vertices) {
-                    auto positon = scene.vertices[vtx.vertex];
-                    auto normal = vtx.normal.has_value()
-                                      ? scene.normals[vtx.normal.value()]
-                                      : Vec3::Zero;
-                    auto texcoord = vtx.texcoord.has_value()
-                                        ? scene.texcoords[vtx.texcoord.value()]
-                                        : Vec2::Zero;
-                    mesh.vertices.push_back(Vertex{positon, normal, texcoord,
-                                                   Vec4{1.0, 1.0, 1.0, 1.0}});
-                }
+            mesh.vertices.reserve(model.triangles.size());
+            for (auto& vtx : model.triangles) {
+                auto positon = scene.vertices[vtx.vertex];
+                auto normal = vtx.normal.has_value()
+                                  ? scene.normals[vtx.normal.value()]
+                                  : Vec3::Zero;
+                auto texcoord = vtx.texcoord.has_value()
+                                    ? scene.texcoords[vtx.texcoord.value()]
+                                    : Vec2::Zero;
+                mesh.vertices.push_back(Vertex{positon, normal, texcoord,
+                                               Vec4{1.0, 1.0, 1.0, 1.0}});
             }
             mesh.material = model.material;
             mesh.mtllib = model.mtllib;
@@ -81,10 +87,46 @@ LoadFromFile(std::string&& filename, PreOperation preOperation) {
                 }
             }
         }
-        return std::tuple<std::vector<Mesh>, std::vector<objloader::Mtllib>>{
-            meshes, scene.materials};
+        return std::tuple<std::vector<Mesh>, std::vector<objloader::Mtllib>,
+                          std::vector<std::filesystem::path>>{
+            meshes, scene.materials, scene.mtllibFiles};
     }
     return std::nullopt;
 }
 
+// 流式加载，每个分组(或分组中的一段)展开成Mesh之后交给onMesh，
+// mesh只在回调期间有效；见objloader::StreamFromFile
+objloader::StreamResult StreamFromFile(
+    const std::string& filename, objloader::StreamOptions options,
+    const std::function<bool(const Mesh&,
+                             const std::vector<objloader::Mtllib>&)>& onMesh) {
+    Mesh mesh = Mesh(std::nullopt);
+    options.bytesPerOutputVertex += sizeof(Vertex);
+    return objloader::StreamFromFile(
+        filename, options, [&](const objloader::StreamedModel& model) {
+            mesh.name = std::string(model.name);
+            mesh.mtllib = model.mtllib;
+            mesh.material = model.material;
+            mesh.vertices.clear();
+            mesh.vertices.reserve(model.triangles.size());
+            for (auto& vtx : model.triangles) {
+                auto normal = vtx.normal.has_value()
+                                  ? model.normals[vtx.normal.value()]
+                                  : Vec3::Zero;
+                auto texcoord = vtx.texcoord.has_value()
+                                    ? model.texcoords[vtx.texcoord.value()]
+                                    : Vec2::Zero;
+                mesh.vertices.push_back(Vertex{model.vertices[vtx.vertex],
+                                               normal, texcoord,
+                                               Vec4{1.0, 1.0, 1.0, 1.0}});
+            }
+            bool ok = onMesh(mesh, model.materials);
+            // 太大的缓冲不保留到下一个mesh
+            if (mesh.vertices.capacity() > MAX_RETAINED_MESH_VERTICES) {
+                mesh.vertices = std::vector<Vertex>();
+            }
+            return ok;
+        });
+}
+
 }  // namespace model
\ No newline at end of file
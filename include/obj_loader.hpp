@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
 #include <filesystem>
+#include <functional>
 #include <fstream>
 #include <initializer_list>
 #include <iostream>
@@ -8,10 +11,15 @@
 #include <map>
 #include <optional>
 #include <queue>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "job_system.hpp"
+#include "mapped_file.hpp"
 #include "math.hpp"
+#include "trace.hpp"
 namespace objloader {
 
 class FileContent {
@@ -46,24 +54,19 @@ class Vertex {
         : vertex(vertex), normal(normal), texcoord(texcoord) {}
 };
 
-class Face {
-   public:
-    std::vector<Vertex> vertices;
-    Face(std::vector<Vertex> vertices) : vertices(vertices) {}
-};
-
 class Model {
    public:
-    std::vector<Face> faces;
+    // 三角化之后的顶点索引，每3个组成一个三角形
+    std::vector<Vertex> triangles;
     std::string name;
     std::optional<uint32_t> mtllib;
     std::optional<std::string> material;
     uint8_t smoothShade;
 
-    Model(std::vector<Face> faces, std::string name,
+    Model(std::vector<Vertex> triangles, std::string name,
           std::optional<uint32_t> mtllib, std::optional<std::string> material,
           uint8_t smmothShade)
-        : faces(faces),
+        : triangles(triangles),
           name(name),
           mtllib(mtllib),
           material(material),
@@ -142,6 +145,8 @@ class SceneData {
     std::vector<Vec2> texcoords;
     std::vector<Mtllib> materials;
     std::vector<Model> models;
+    // 引用到的mtl文件(包括没能打开的)
+    std::vector<std::filesystem::path> mtllibFiles;
 };
 
 // 去掉字符串的空格并保存为vector
@@ -249,19 +254,6 @@ inline std::optional<T> parseAsT(TokenType &token, TokenRequester &requester) {
     }
 }
 
-std::vector<std::string> split(std::string str, std::string delimiter) {
-    std::vector<std::string> ret;
-    size_t pos = 0;
-    std::string token;
-    while ((pos = str.find(delimiter)) != std::string::npos) {
-        token = str.substr(0, pos);
-        ret.push_back(token);
-        str.erase(0, pos + delimiter.length());
-    }
-    ret.push_back(str);
-    return ret;
-}
-
 class MtllibParser {
    public:
     TokenRequester &tokenRequester;
@@ -399,147 +391,687 @@ class MtllibParser {
     }
 };
 
+// 以下是OBJ的解析：文件映射到内存后单遍扫描，token都是指向文件内容的
+// string_view，数字用from_chars解析，不产生中间字符串
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// 取出下一个空白分隔的token，遇到#认为是注释，后面的内容都忽略
+inline std::string_view NextToken(std::string_view &line) {
+    size_t begin = 0;
+    while (begin < line.size() && IsBlank(line[begin])) {
+        begin++;
+    }
+    if (begin == line.size() || line[begin] == '#') {
+        line = std::string_view();
+        return std::string_view();
+    }
+    size_t end = begin;
+    while (end < line.size() && !IsBlank(line[end])) {
+        end++;
+    }
+    auto token = line.substr(begin, end - begin);
+    line.remove_prefix(end);
+    return token;
+}
+
+// 去掉两端的空白和行尾注释，用于文件名和对象名
+inline std::string_view TrimRest(std::string_view line) {
+    auto comment = line.find('#');
+    if (comment != std::string_view::npos) {
+        line = line.substr(0, comment);
+    }
+    while (!line.empty() && IsBlank(line.front())) {
+        line.remove_prefix(1);
+    }
+    while (!line.empty() && IsBlank(line.back())) {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+inline bool ParseFloat(std::string_view token, float &value) {
+    // from_chars不接受前导的'+'
+    if (!token.empty() && token.front() == '+') {
+        token.remove_prefix(1);
+    }
+    auto [ptr, ec] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    return ec == std::errc() && ptr == token.data() + token.size();
+}
+
+template <size_t Dim>
+inline bool ParseVector(std::string_view &line, Vector<Dim> &v) {
+    for (size_t i = 0; i < Dim; i++) {
+        if (!ParseFloat(NextToken(line), v.data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 面里的索引先原样保存，0表示没有(OBJ的索引不会是0)
+inline bool ParseIndex(std::string_view token, int32_t &value) {
+    auto [ptr, ec] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    return ec == std::errc() && ptr == token.data() + token.size() &&
+           value != 0;
+}
+
+// OBJ的索引从1开始，负数表示相对当前已有元素的末尾
+inline bool ResolveIndex(int32_t value, size_t count, uint32_t &index) {
+    int64_t resolved = value < 0 ? (int64_t)count + value : (int64_t)value - 1;
+    if (resolved < 0 || resolved >= (int64_t)count) {
+        return false;
+    }
+    index = (uint32_t)resolved;
+    return true;
+}
+
+// 面中一个顶点的原始索引
+struct RawFaceVertex {
+    int32_t vertex;
+    int32_t texcoord;
+    int32_t normal;
+};
+
+// 一个面：顶点在faceVertices中的范围，以及出现时块内已有的v/vt/vn数量
+// 相对索引和越界检查要等知道块前面有多少元素之后才能处理
+struct RawFace {
+    uint32_t first;
+    uint32_t count;
+    uint32_t vertexCount;
+    uint32_t texcoordCount;
+    uint32_t normalCount;
+};
+
+// 分组相关的记录，按出现顺序在拼接时重放
+struct ObjCommand {
+    enum Type { NewModel, UseMtl, Smooth, Mtllib, Faces };
+    Type type;
+    std::string name;
+    uint8_t smooth = 0;
+    // Faces: 面的范围，解析索引之后变成三角形顶点的范围
+    uint32_t begin = 0;
+    uint32_t end = 0;
+};
+
+// 文件的一段(按行切分)的解析结果
+struct ObjChunk {
+    std::vector<Vec3> vertices;
+    std::vector<Vec2> texcoords;
+    std::vector<Vec3> normals;
+    std::vector<RawFaceVertex> faceVertices;
+    std::vector<RawFace> faces;
+    std::vector<ObjCommand> commands;
+    std::vector<Vertex> triangles;
+};
+
+// 解析一段内容，不依赖其他段，可以并行
+class ObjChunkParser {
+   public:
+    explicit ObjChunkParser(ObjChunk &chunk) : chunk_(chunk) {}
+
+    void parse(std::string_view content) {
+        TRACE_ZONE("obj parse");
+        while (!content.empty()) {
+            auto newline = content.find('\n');
+            std::string_view line;
+            if (newline == std::string_view::npos) {
+                line = content;
+                content = std::string_view();
+            } else {
+                line = content.substr(0, newline);
+                content.remove_prefix(newline + 1);
+            }
+            parseLine(line);
+        }
+    }
+
+    // 流式加载时逐行调用
+    void parseLine(std::string_view line) {
+        auto keyword = NextToken(line);
+        if (keyword.empty()) {
+            return;
+        }
+        if (keyword == "v") {
+            Vec3 v;
+            if (ParseVector<3>(line, v)) {
+                chunk_.vertices.push_back(v);
+            }
+        } else if (keyword == "vt") {
+            Vec2 v;
+            if (ParseVector<2>(line, v)) {
+                chunk_.texcoords.push_back(v);
+            }
+        } else if (keyword == "vn") {
+            Vec3 v;
+            if (ParseVector<3>(line, v)) {
+                chunk_.normals.push_back(v);
+            }
+        } else if (keyword == "f") {
+            parseFace(line);
+        } else if (keyword == "g" || keyword == "o") {
+            auto name = NextToken(line);
+            if (!name.empty()) {
+                pushCommand(ObjCommand::NewModel, name);
+            }
+        } else if (keyword == "usemtl") {
+            auto name = NextToken(line);
+            if (!name.empty()) {
+                pushCommand(ObjCommand::UseMtl, name);
+            }
+        } else if (keyword == "s") {
+            auto value = NextToken(line);
+            float smooth = 0.0f;
+            if (!value.empty()) {
+                // s off 按0处理
+                ParseFloat(value, smooth);
+                pushCommand(ObjCommand::Smooth, "", (uint8_t)smooth);
+            }
+        } else if (keyword == "mtllib") {
+            auto name = TrimRest(line);
+            if (!name.empty()) {
+                pushCommand(ObjCommand::Mtllib, name);
+            }
+        }
+    }
+
+   private:
+    ObjChunk &chunk_;
+
+    void pushCommand(ObjCommand::Type type, std::string_view name,
+                     uint8_t smooth = 0) {
+        ObjCommand command{type, std::string(name), smooth};
+        chunk_.commands.push_back(std::move(command));
+    }
+
+    // 支持 v、v/t、v//n、v/t/n
+    static bool parseFaceVertex(std::string_view token,
+                                RawFaceVertex &vertex) {
+        vertex = RawFaceVertex{0, 0, 0};
+        auto firstSlash = token.find('/');
+        if (!ParseIndex(token.substr(0, firstSlash), vertex.vertex)) {
+            return false;
+        }
+        if (firstSlash == std::string_view::npos) {
+            return true;
+        }
+        auto rest = token.substr(firstSlash + 1);
+        auto secondSlash = rest.find('/');
+        auto texcoord = rest.substr(0, secondSlash);
+        if (!texcoord.empty() && !ParseIndex(texcoord, vertex.texcoord)) {
+            return false;
+        }
+        if (secondSlash != std::string_view::npos) {
+            auto normal = rest.substr(secondSlash + 1);
+            if (!normal.empty() && !ParseIndex(normal, vertex.normal)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void parseFace(std::string_view line) {
+        auto first = (uint32_t)chunk_.faceVertices.size();
+        while (true) {
+            auto token = NextToken(line);
+            if (token.empty()) {
+                break;
+            }
+            RawFaceVertex vertex;
+            // 格式错误的面整个丢弃
+            if (!parseFaceVertex(token, vertex)) {
+                chunk_.faceVertices.resize(first);
+                return;
+            }
+            chunk_.faceVertices.push_back(vertex);
+        }
+        auto count = (uint32_t)chunk_.faceVertices.size() - first;
+        if (count < 3) {
+            chunk_.faceVertices.resize(first);
+            return;
+        }
+        if (chunk_.commands.empty() ||
+            chunk_.commands.back().type != ObjCommand::Faces) {
+            ObjCommand command{ObjCommand::Faces};
+            command.begin = (uint32_t)chunk_.faces.size();
+            chunk_.commands.push_back(std::move(command));
+        }
+        chunk_.faces.push_back(RawFace{first, count,
+                                       (uint32_t)chunk_.vertices.size(),
+                                       (uint32_t)chunk_.texcoords.size(),
+                                       (uint32_t)chunk_.normals.size()});
+        chunk_.commands.back().end = (uint32_t)chunk_.faces.size();
+    }
+};
+
+// 知道块前面有多少v/vt/vn之后，把面的索引换成全局索引并三角化
+// 有越界索引的面整个丢弃，避免之后越界访问
+inline void ResolveChunkFaces(ObjChunk &chunk, size_t vertexBase,
+                              size_t texcoordBase, size_t normalBase) {
+    chunk.triangles.clear();
+    // n边形产生n-2个三角形
+    chunk.triangles.reserve(
+        (chunk.faceVertices.size() - 2 * chunk.faces.size()) * 3);
+    std::vector<Vertex> polygon;
+    for (auto &command : chunk.commands) {
+        if (command.type != ObjCommand::Faces) {
+            continue;
+        }
+        auto triangleBegin = (uint32_t)chunk.triangles.size();
+        for (uint32_t f = command.begin; f < command.end; f++) {
+            auto &face = chunk.faces[f];
+            polygon.clear();
+            bool valid = true;
+            for (uint32_t i = 0; i < face.count && valid; i++) {
+                auto &raw = chunk.faceVertices[face.first + i];
+                Vertex vertex{0, std::nullopt, std::nullopt};
+                uint32_t index = 0;
+                valid = ResolveIndex(raw.vertex, vertexBase + face.vertexCount,
+                                     vertex.vertex);
+                if (valid && raw.texcoord != 0) {
+                    valid = ResolveIndex(raw.texcoord,
+                                         texcoordBase + face.texcoordCount,
+                                         index);
+                    if (valid) {
+                        vertex.texcoord = index;
+                    }
+                }
+                if (valid && raw.normal != 0) {
+                    valid = ResolveIndex(
+                        raw.normal, normalBase + face.normalCount, index);
+                    if (valid) {
+                        vertex.normal = index;
+                    }
+                }
+                polygon.push_back(vertex);
+            }
+            if (!valid) {
+                continue;
+            }
+            // 凸多边形按扇形三角化
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                chunk.triangles.push_back(polygon[0]);
+                chunk.triangles.push_back(polygon[i]);
+                chunk.triangles.push_back(polygon[i + 1]);
+            }
+        }
+        command.begin = triangleBegin;
+        command.end = (uint32_t)chunk.triangles.size();
+    }
+    // 原始数据已经不需要了
+    chunk.faces = std::vector<RawFace>();
+    chunk.faceVertices = std::vector<RawFaceVertex>();
+}
+
+// 在共享的任务线程上运行task(0..count-1)，全部完成后返回
+template <typename Task>
+void RunParallel(size_t count, Task task) {
+    JobSystem::Global().ParallelFor(0, count, 1,
+                                    [&task](size_t first, size_t last) {
+                                        for (size_t i = first; i < last; i++) {
+                                            task(i);
+                                        }
+                                    });
+}
+
+// 小于这个大小的块不值得单独开线程
+const size_t MIN_OBJ_CHUNK_SIZE = 4 << 20;
+
 class ObjParser {
    public:
     SceneData scene;
-    std::filesystem::path &dirpath;
-    TokenRequester &tokenRequester;
 
-    ObjParser(std::filesystem::path &dirpath, TokenRequester &tokenRequester)
-        : dirpath(dirpath),
-          tokenRequester(tokenRequester),
-          scene(SceneData()) {}
+    explicit ObjParser(const std::filesystem::path &filepath)
+        : filepath_(filepath) {}
 
-    void parse() {
-        auto token = tokenRequester.Request();
-        bool parseFinish = false;
-        while (!parseFinish) {
-            switch (token.type) {
-                case TokenType::Type::Token:
-                    if (token.str == "#") {
-                        IgnoreUntil(token, tokenRequester);
-                    } else if (token.str == "g" || token.str == "o") {
-                        auto nameOpt = ParseAsString(token, tokenRequester);
-                        if (nameOpt.has_value()) {
-                            scene.models.push_back(Model{
-                                std::vector<Face>{}, nameOpt.value(),
-                                scene.materials.empty()
-                                    ? std::optional<uint32_t>(std::nullopt)
-                                    : std::optional<uint32_t>(
-                                          scene.materials.size() - 1),
-                                std::optional<std::string>(std::nullopt), 0
-
-                            });
-                        }
-                    } else if (token.str == "v") {
-                        auto v3Opt = parseAsVector<3>(token, tokenRequester);
-                        if (v3Opt.has_value()) {
-                            scene.vertices.push_back(v3Opt.value());
-                        }
-                    } else if (token.str == "vt") {
-                        auto v2Opt = parseAsVector<2>(token, tokenRequester);
-                        if (v2Opt.has_value()) {
-                            scene.texcoords.push_back(v2Opt.value());
-                        }
-                    } else if (token.str == "vn") {
-                        auto v3Opt = parseAsVector<3>(token, tokenRequester);
-                        if (v3Opt.has_value()) {
-                            scene.normals.push_back(v3Opt.value());
-                        }
-                    } else if (token.str == "f") {
-                        token = tokenRequester.Request();
-                        std::vector<Vertex> vertices;
-                        bool finish = false;
-                        while (!finish) {
-                            if (token.type == TokenType::Type::Token) {
-                                auto indices = split(token.str, "/");
-                                if (indices.size() == 3) {
-                                    uint32_t vertex =
-                                        ::atoi(indices[0].c_str()) - 1;
-                                    std::optional<uint32_t> texcoord =
-                                        indices[1].empty()
-                                            ? std::optional<uint32_t>(
-                                                  std::nullopt)
-                                            : std::optional<uint32_t>(
-                                                  ::atoi(indices[1].c_str()) -
-                                                  1);
-                                    std::optional<uint32_t> normal =
-                                        indices[2].empty()
-                                            ? std::optional<uint32_t>(
-                                                  std::nullopt)
-                                            : std::optional<uint32_t>(
-                                                  ::atoi(indices[2].c_str()) -
-                                                  1);
-                                    vertices.push_back(
-                                        Vertex{vertex, normal, texcoord});
-                                }
-                            } else {
-                                // 吃掉换行
-                                finish = true;
-                            }
-                            token = tokenRequester.Request();
-                        }
-                        scene.models.back().faces.push_back(Face{vertices});
-                    } else if (token.str == "mtllib") {
-                        token = tokenRequester.Request();
-                        if (token.type == TokenType::Type::Token) {
-                            auto parentPath = dirpath.parent_path();
-                            auto filepath = parentPath.append(token.str);
-                            auto fileContentOpt =
-                                FileContent::fromFile(filepath);
-                            if (fileContentOpt.has_value()) {
-                                auto mtllibTokenRequester =
-                                    TokenRequester::New(fileContentOpt.value());
-                                if (mtllibTokenRequester.has_value()) {
-                                    auto mtlibParser = MtllibParser(
-                                        mtllibTokenRequester.value());
-                                    scene.materials.push_back(
-                                        mtlibParser.parse());
-                                }
-                            }
-                            token = tokenRequester.Request();
-                        }
-                    } else if (token.str == "usemtl") {
-                        auto nameOpt = ParseAsString(token, tokenRequester);
-                        if (nameOpt.has_value()) {
-                            scene.models.back().material = nameOpt.value();
-                        }
-                    } else if (token.str == "s") {
-                        auto u8Opt = parseAsT<uint8_t>(token, tokenRequester);
-                        if (u8Opt.has_value()) {
-                            scene.models.back().smoothShade = u8Opt.value();
-                        }
-                    } else {
-                        // 尝试跳到下一行
-                        IgnoreUntil(token, tokenRequester);
-                    }
+    // 按行边界把内容切成若干块并行解析，再按顺序拼接
+    // 结果和单线程解析完全一致，threads为0时按任务线程数切分
+    void parse(std::string_view content, uint32_t threads = 0) {
+        if (threads == 0) {
+            threads = JobSystem::Global().WorkerCount();
+        }
+        auto chunkCount = std::clamp<size_t>(
+            content.size() / MIN_OBJ_CHUNK_SIZE, 1, threads);
+        auto pieces = splitLines(content, chunkCount);
+        std::vector<ObjChunk> chunks(pieces.size());
+        RunParallel(chunks.size(), [&](size_t i) {
+            ObjChunkParser(chunks[i]).parse(pieces[i]);
+        });
+
+        // 前缀和得到每块的全局起始索引
+        std::vector<size_t> vertexBase(chunks.size() + 1, 0);
+        std::vector<size_t> texcoordBase(chunks.size() + 1, 0);
+        std::vector<size_t> normalBase(chunks.size() + 1, 0);
+        for (size_t i = 0; i < chunks.size(); i++) {
+            vertexBase[i + 1] = vertexBase[i] + chunks[i].vertices.size();
+            texcoordBase[i + 1] =
+                texcoordBase[i] + chunks[i].texcoords.size();
+            normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+        }
+        scene.vertices.resize(vertexBase.back());
+        scene.texcoords.resize(texcoordBase.back());
+        scene.normals.resize(normalBase.back());
+        RunParallel(chunks.size(), [&](size_t i) {
+            auto &chunk = chunks[i];
+            ResolveChunkFaces(chunk, vertexBase[i], texcoordBase[i],
+                              normalBase[i]);
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+                      scene.vertices.begin() + vertexBase[i]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                      scene.texcoords.begin() + texcoordBase[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(),
+                      scene.normals.begin() + normalBase[i]);
+            chunk.vertices = std::vector<Vec3>();
+            chunk.texcoords = std::vector<Vec2>();
+            chunk.normals = std::vector<Vec3>();
+        });
+
+        for (auto &chunk : chunks) {
+            stitch(chunk);
+        }
+    }
+
+   private:
+    std::filesystem::path filepath_;
+
+    static std::vector<std::string_view> splitLines(std::string_view content,
+                                                    size_t count) {
+        std::vector<std::string_view> pieces;
+        size_t begin = 0;
+        for (size_t i = 1; i <= count && begin < content.size(); i++) {
+            size_t end = content.size();
+            if (i < count) {
+                end = std::max(begin, content.size() * i / count);
+                auto newline = content.find('\n', end);
+                end = newline == std::string_view::npos ? content.size()
+                                                        : newline + 1;
+            }
+            pieces.push_back(content.substr(begin, end - begin));
+            begin = end;
+        }
+        if (pieces.empty()) {
+            pieces.push_back(content);
+        }
+        return pieces;
+    }
+
+    // 没有g/o就出现面时，放进一个默认的模型
+    Model &currentModel() {
+        if (scene.models.empty()) {
+            scene.models.push_back(Model{std::vector<Vertex>{}, "default",
+                                         currentMtllib(), std::nullopt, 0});
+        }
+        return scene.models.back();
+    }
+
+    std::optional<uint32_t> currentMtllib() const {
+        return scene.materials.empty()
+                   ? std::optional<uint32_t>(std::nullopt)
+                   : std::optional<uint32_t>(scene.materials.size() - 1);
+    }
+
+    // 按顺序重放分组记录，把三角形拼到对应的模型里
+    void stitch(ObjChunk &chunk) {
+        for (auto &command : chunk.commands) {
+            switch (command.type) {
+                case ObjCommand::NewModel:
+                    scene.models.push_back(Model{std::vector<Vertex>{},
+                                                 command.name, currentMtllib(),
+                                                 std::nullopt, 0});
                     break;
-                case TokenType::Type::Eof:
-                    parseFinish = true;
+                case ObjCommand::UseMtl:
+                    currentModel().material = command.name;
                     break;
-                case TokenType::Type::Nextline:
-                    token = tokenRequester.Request();
+                case ObjCommand::Smooth:
+                    currentModel().smoothShade = command.smooth;
                     break;
-                default:
+                case ObjCommand::Mtllib:
+                    parseMtllib(command.name);
+                    break;
+                case ObjCommand::Faces:
+                    if (command.end > command.begin) {
+                        auto &triangles = currentModel().triangles;
+                        // 整块都属于一个还空着的模型时直接移动
+                        if (triangles.empty() && command.begin == 0 &&
+                            command.end == chunk.triangles.size()) {
+                            triangles = std::move(chunk.triangles);
+                            break;
+                        }
+                        triangles.insert(
+                            triangles.end(),
+                            chunk.triangles.begin() + command.begin,
+                            chunk.triangles.begin() + command.end);
+                    }
                     break;
             }
         }
+        chunk.triangles = std::vector<Vertex>();
+    }
+
+    void parseMtllib(const std::string &name) {
+        auto filepath = filepath_.parent_path().append(name);
+        scene.mtllibFiles.push_back(filepath);
+        auto fileContentOpt = FileContent::fromFile(filepath);
+        if (fileContentOpt.has_value()) {
+            auto mtllibTokenRequester =
+                TokenRequester::New(fileContentOpt.value());
+            if (mtllibTokenRequester.has_value()) {
+                auto mtlibParser = MtllibParser(mtllibTokenRequester.value());
+                scene.materials.push_back(mtlibParser.parse());
+            }
+        }
     }
 };
 
-std::optional<SceneData> LoadFromFile(std::string &filename) {
+// threads为0时按任务线程数切分，1为单线程解析
+std::optional<SceneData> LoadFromFile(std::string &filename,
+                                      uint32_t threads = 0) {
     auto filepath = std::filesystem::path(filename);
-    auto fcOpt = FileContent::fromFile(filepath);
-    if (fcOpt.has_value()) {
-        auto trOpt = TokenRequester::New(fcOpt.value());
-        if (trOpt.has_value()) {
-            auto parser = ObjParser(filepath, trOpt.value());
-            parser.parse();
-            return parser.scene;
-        }
+    MappedFile file;
+    if (!file.Open(filepath)) {
         return std::nullopt;
     }
-    return std::nullopt;
+    auto parser = ObjParser(filepath);
+    parser.parse(file.View(), threads);
+    return std::move(parser.scene);
+}
+
+// 流式加载时交给调用方的一个mesh，引用的数据只在回调期间有效
+struct StreamedModel {
+    std::string_view name;
+    std::optional<uint32_t> mtllib;
+    std::optional<std::string> material;
+    // 三角化之后的索引，指向vertices/texcoords/normals
+    std::span<const Vertex> triangles;
+    std::span<const Vec3> vertices;
+    std::span<const Vec2> texcoords;
+    std::span<const Vec3> normals;
+    const std::vector<Mtllib> &materials;
+};
+
+struct StreamOptions {
+    // 加载过程中保留的数据(v/vt/vn、还没交出去的面)的内存上限，0表示不限制
+    size_t memoryLimit = 0;
+    // 调用方处理每个三角形顶点需要的内存，用来估算还能攒多少面
+    size_t bytesPerOutputVertex = 0;
+    // 解析进度(已读字节数, 文件大小)，返回false时中止加载
+    std::function<bool(size_t, size_t)> onProgress;
+};
+
+struct StreamResult {
+    bool ok = false;
+    std::string error;
+    size_t meshCount = 0;
+    // 估算的峰值内存
+    size_t peakMemory = 0;
+    // 引用到的mtl文件(包括没能打开的)
+    std::vector<std::filesystem::path> mtllibFiles;
+};
+
+// 顺序读取已经解析过的部分超过这个大小就从常驻内存中换出
+const size_t STREAM_RELEASE_SIZE = 32 << 20;
+// 每解析这么多字节报告一次进度
+const size_t STREAM_PROGRESS_INTERVAL = 1 << 20;
+
+// 流式加载：按g/o分组，每组(或材质切换时)解析完立即交给onModel，
+// 交出去的面马上释放；设置了内存上限时，一组太大会拆成多次交出
+// v/vt/vn会被之后的面引用，只能保留到最后
+// onModel返回false时中止加载
+StreamResult StreamFromFile(
+    const std::string &filename, const StreamOptions &options,
+    const std::function<bool(const StreamedModel &)> &onModel) {
+    TRACE_ZONE("obj load");
+    StreamResult result;
+    auto filepath = std::filesystem::path(filename);
+    MappedFile file;
+    if (!file.Open(filepath)) {
+        result.error = "can't open " + filename;
+        return result;
+    }
+
+    ObjChunk chunk;
+    ObjChunkParser parser(chunk);
+    std::vector<Mtllib> materials;
+    std::string name = "default";
+    std::optional<uint32_t> mtllib;
+    std::optional<std::string> material;
+    bool hasModel = false;
+    bool aborted = false;
+
+    auto currentMtllib = [&]() {
+        return materials.empty()
+                   ? std::optional<uint32_t>(std::nullopt)
+                   : std::optional<uint32_t>(materials.size() - 1);
+    };
+    auto geometryBytes = [&]() {
+        return chunk.vertices.capacity() * sizeof(Vec3) +
+               chunk.texcoords.capacity() * sizeof(Vec2) +
+               chunk.normals.capacity() * sizeof(Vec3);
+    };
+    auto pendingBytes = [&]() {
+        auto corners = (chunk.faceVertices.size() - 2 * chunk.faces.size()) * 3;
+        return chunk.faceVertices.capacity() * sizeof(RawFaceVertex) +
+               chunk.faces.capacity() * sizeof(RawFace) +
+               corners * (sizeof(Vertex) + options.bytesPerOutputVertex);
+    };
+    auto flush = [&]() {
+        if (chunk.faces.empty()) {
+            chunk.commands.clear();
+            return true;
+        }
+        if (!hasModel) {
+            mtllib = currentMtllib();
+            hasModel = true;
+        }
+        ResolveChunkFaces(chunk, 0, 0, 0);
+        chunk.commands.clear();
+        bool ok = true;
+        if (!chunk.triangles.empty()) {
+            ok = onModel(StreamedModel{name, mtllib, material,
+                                       chunk.triangles, chunk.vertices,
+                                       chunk.texcoords, chunk.normals,
+                                       materials});
+            result.meshCount++;
+        }
+        chunk.triangles = std::vector<Vertex>();
+        return ok;
+    };
+
+    auto content = file.View();
+    size_t offset = 0;
+    size_t released = 0;
+    size_t reported = 0;
+    while (offset < content.size() && !aborted) {
+        auto newline = content.find('\n', offset);
+        auto end = newline == std::string_view::npos ? content.size() : newline;
+        auto commandCount = chunk.commands.size();
+        parser.parseLine(content.substr(offset, end - offset));
+        offset = end + 1;
+
+        // 处理这一行产生的分组记录，面留在chunk里等待交出
+        for (size_t i = commandCount; i < chunk.commands.size() && !aborted;
+             i++) {
+            auto command = chunk.commands[i];
+            switch (command.type) {
+                case ObjCommand::NewModel:
+                    aborted = !flush();
+                    name = command.name;
+                    mtllib = currentMtllib();
+                    material = std::nullopt;
+                    hasModel = true;
+                    break;
+                case ObjCommand::UseMtl:
+                    if (material != command.name) {
+                        aborted = !flush();
+                        material = command.name;
+                    }
+                    break;
+                case ObjCommand::Mtllib: {
+                    auto path = filepath.parent_path().append(command.name);
+                    result.mtllibFiles.push_back(path);
+                    auto fileContentOpt = FileContent::fromFile(path);
+                    if (fileContentOpt.has_value()) {
+                        auto requester =
+                            TokenRequester::New(fileContentOpt.value());
+                        if (requester.has_value()) {
+                            materials.push_back(
+                                MtllibParser(requester.value()).parse());
+                        }
+                    }
+                    break;
+                }
+                case ObjCommand::Smooth:
+                case ObjCommand::Faces:
+                    break;
+            }
+            if (chunk.commands.empty()) {
+                break;
+            }
+        }
+        // 分组记录已经处理过了，还没交出的面都属于当前mesh，合并成一条
+        chunk.commands.clear();
+        if (!chunk.faces.empty()) {
+            ObjCommand faces{ObjCommand::Faces};
+            faces.begin = 0;
+            faces.end = (uint32_t)chunk.faces.size();
+            chunk.commands.push_back(std::move(faces));
+        }
+
+        auto used = geometryBytes() + pendingBytes();
+        result.peakMemory = std::max(result.peakMemory, used);
+        if (options.memoryLimit > 0) {
+            if (used > options.memoryLimit && !aborted) {
+                aborted = !flush();
+                if (geometryBytes() > options.memoryLimit) {
+                    result.error = "vertex data alone exceeds memory limit";
+                    return result;
+                }
+            }
+        }
+        if (options.onProgress &&
+            offset - reported >= STREAM_PROGRESS_INTERVAL) {
+            reported = offset;
+            if (!options.onProgress(std::min(offset, content.size()),
+                                    content.size())) {
+                result.error = "cancelled";
+                return result;
+            }
+        }
+        if (offset - released >= STREAM_RELEASE_SIZE) {
+            file.Release(released, offset - released);
+            released = offset;
+        }
+    }
+    if (aborted || !flush()) {
+        result.error = "aborted by consumer";
+        return result;
+    }
+    result.peakMemory =
+        std::max(result.peakMemory, geometryBytes() + pendingBytes());
+    result.ok = true;
+    return result;
 }
 
-}  // namespace objloader
\ No newline at end of file
+}  // namespace objloader
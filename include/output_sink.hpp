@@ -0,0 +1,369 @@
+#pragma once
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTRENDER_SSE2
+#endif
+
+#include "SDL.h"
+
+// 帧输出接口，像素格式为FRAMEBUFFER_FORMAT(内存中字节顺序为b,g,r,a)
+class IOutputSink {
+   public:
+    virtual ~IOutputSink() {}
+    virtual bool Write(std::span<const uint32_t> pixels, uint32_t w,
+                       uint32_t h) = 0;
+};
+
+// 打开输出文件，"-"表示标准输出
+inline int OpenOutputFd(const std::string &path) {
+#ifdef _WIN32
+    if (path == "-") {
+        _setmode(1, _O_BINARY);
+        return 1;
+    }
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 0644);
+#else
+    if (path == "-") {
+        return 1;
+    }
+    return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+inline void CloseOutputFd(int fd) {
+    if (fd > 2) {
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+    }
+}
+
+// 写完所有字节，管道可能一次写不完
+inline bool WriteAll(int fd, const void *data, size_t size) {
+    auto ptr = (const uint8_t *)data;
+    while (size > 0) {
+#ifdef _WIN32
+        auto n = _write(fd, ptr, (unsigned int)size);
+#else
+        auto n = write(fd, ptr, size);
+#endif
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+// BT.601 limited range
+inline uint8_t RgbToY(int r, int g, int b) {
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+inline uint8_t RgbToU(int r, int g, int b) {
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+inline uint8_t RgbToV(int r, int g, int b) {
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+#ifdef SOFTRENDER_SSE2
+// 4个像素(b,g,r,a交错)和系数做点积，结果是4个int32
+inline __m128i DotBGRA4(__m128i pixels, __m128i coeff) {
+    __m128i zero = _mm_setzero_si128();
+    // 每个像素的(b*cb + g*cg), (r*cr + a*0)
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coeff);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coeff);
+    // 相邻两项相加得到每个像素的点积
+    __m128i sumLo = _mm_add_epi32(
+        lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i sumHi = _mm_add_epi32(
+        hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+    // 取出第0和第2项
+    return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(sumLo),
+                                           _mm_castsi128_ps(sumHi),
+                                           _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// (value + 128) >> 8 + offset，再压成4个字节
+inline uint32_t PackLuma4(__m128i dot, int offset) {
+    __m128i v = _mm_add_epi32(
+        _mm_srai_epi32(_mm_add_epi32(dot, _mm_set1_epi32(128)), 8),
+        _mm_set1_epi32(offset));
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+#endif
+
+// RGBA到I420，色度取2x2块的平均值，w和h可以是奇数
+void ConvertToI420(std::span<const uint32_t> pixels, uint32_t w, uint32_t h,
+                   uint8_t *yPlane, uint8_t *uPlane, uint8_t *vPlane) {
+    uint32_t cw = (w + 1) / 2;
+    uint32_t ch = (h + 1) / 2;
+    for (uint32_t y = 0; y < h; y++) {
+        auto row = pixels.data() + y * w;
+        auto dst = yPlane + y * w;
+        uint32_t x = 0;
+#ifdef SOFTRENDER_SSE2
+        const __m128i coeffY = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+        for (; x + 4 <= w; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(row + x));
+            uint32_t packed = PackLuma4(DotBGRA4(p, coeffY), 16);
+            memcpy(dst + x, &packed, 4);
+        }
+#endif
+        for (; x < w; x++) {
+            auto p = row[x];
+            dst[x] = RgbToY((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF);
+        }
+    }
+    for (uint32_t cy = 0; cy < ch; cy++) {
+        auto row0 = pixels.data() + (cy * 2) * w;
+        auto row1 = pixels.data() + std::min(cy * 2 + 1, h - 1) * w;
+        auto dstU = uPlane + cy * cw;
+        auto dstV = vPlane + cy * cw;
+        uint32_t cx = 0;
+#ifdef SOFTRENDER_SSE2
+        const __m128i coeffU =
+            _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+        const __m128i coeffV =
+            _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+        // 每次处理8个像素宽、输出4个色度
+        for (; cx * 2 + 8 <= w; cx += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + cx * 2));
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + cx * 2 + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + cx * 2));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + cx * 2 + 4));
+            // 竖直方向平均
+            __m128i v0 = _mm_avg_epu8(a0, b0);
+            __m128i v1 = _mm_avg_epu8(a1, b1);
+            // 水平方向：把偶数像素和奇数像素分开再平均
+            __m128 f0 = _mm_castsi128_ps(v0);
+            __m128 f1 = _mm_castsi128_ps(v1);
+            __m128i even = _mm_castps_si128(
+                _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(
+                _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i avg = _mm_avg_epu8(even, odd);
+            uint32_t u = PackLuma4(DotBGRA4(avg, coeffU), 128);
+            uint32_t v = PackLuma4(DotBGRA4(avg, coeffV), 128);
+            memcpy(dstU + cx, &u, 4);
+            memcpy(dstV + cx, &v, 4);
+        }
+#endif
+        for (; cx < cw; cx++) {
+            uint32_t x0 = cx * 2;
+            uint32_t x1 = std::min(x0 + 1, w - 1);
+            // 和SIMD路径一样，先竖直再水平做带舍入的平均
+            auto avg = [](uint32_t a, uint32_t b, int shift) {
+                return (((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + 1) / 2;
+            };
+            auto channel = [&](int shift) {
+                return (avg(row0[x0], row1[x0], shift) +
+                        avg(row0[x1], row1[x1], shift) + 1) /
+                       2;
+            };
+            int r = channel(16);
+            int g = channel(8);
+            int b = channel(0);
+            dstU[cx] = RgbToU(r, g, b);
+            dstV[cx] = RgbToV(r, g, b);
+        }
+    }
+}
+
+// YUV4MPEG2流，可以直接管道给ffmpeg/x264等编码器
+class Y4MSink : public IOutputSink {
+   public:
+    Y4MSink(int fd, uint32_t fps) : fd_(fd), fps_(fps) {}
+
+    ~Y4MSink() { CloseOutputFd(fd_); }
+
+    bool Write(std::span<const uint32_t> pixels, uint32_t w,
+               uint32_t h) override {
+        if (!headerWritten_) {
+            char header[96];
+            int len = snprintf(header, sizeof(header),
+                               "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", w,
+                               h, fps_);
+            if (!WriteAll(fd_, header, len)) {
+                return false;
+            }
+            headerWritten_ = true;
+        }
+        uint32_t lumaSize = w * h;
+        uint32_t chromaSize = ((w + 1) / 2) * ((h + 1) / 2);
+        frame_.resize(6 + lumaSize + chromaSize * 2);
+        memcpy(frame_.data(), "FRAME\n", 6);
+        auto yPlane = frame_.data() + 6;
+        ConvertToI420(pixels, w, h, yPlane, yPlane + lumaSize,
+                      yPlane + lumaSize + chromaSize);
+        return WriteAll(fd_, frame_.data(), frame_.size());
+    }
+
+   private:
+    int fd_;
+    uint32_t fps_;
+    bool headerWritten_ = false;
+    std::vector<uint8_t> frame_;
+};
+
+// 原始rgb24流(ffmpeg -f rawvideo -pix_fmt rgb24)
+class RawRGBSink : public IOutputSink {
+   public:
+    explicit RawRGBSink(int fd) : fd_(fd) {}
+
+    ~RawRGBSink() { CloseOutputFd(fd_); }
+
+    bool Write(std::span<const uint32_t> pixels, uint32_t w,
+               uint32_t h) override {
+        frame_.resize(w * h * 3);
+        for (uint32_t i = 0; i < w * h; i++) {
+            auto p = pixels[i];
+            frame_[i * 3] = (p >> 16) & 0xFF;
+            frame_[i * 3 + 1] = (p >> 8) & 0xFF;
+            frame_[i * 3 + 2] = p & 0xFF;
+        }
+        return WriteAll(fd_, frame_.data(), frame_.size());
+    }
+
+   private:
+    int fd_;
+    std::vector<uint8_t> frame_;
+};
+
+// 在单独的线程上写出帧
+// 帧缓冲在一个固定大小的环里复用，渲染线程只做一次拷贝；
+// 格式转换和写入都在写线程上，磁盘或管道卡住时不会拖住光栅化
+class AsyncFrameWriter {
+   public:
+    // Block: 环满时等待空位，保证不丢帧
+    // DropFrame: 环满时直接丢弃当前帧，渲染线程永远不会等待
+    enum class OverflowPolicy { Block, DropFrame };
+
+    AsyncFrameWriter(std::unique_ptr<IOutputSink> sink, size_t ringSize = 4,
+                     OverflowPolicy policy = OverflowPolicy::Block)
+        : sink_(std::move(sink)), ring_(ringSize), policy_(policy) {
+        thread_ = std::thread([this]() { writeLoop(); });
+    }
+
+    ~AsyncFrameWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    // 返回false表示这一帧被丢弃
+    bool Submit(std::span<const uint32_t> pixels, uint32_t w, uint32_t h) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (count_ == ring_.size()) {
+            if (policy_ == OverflowPolicy::DropFrame || failed_) {
+                dropped_++;
+                return false;
+            }
+            cond_.wait(lock, [this]() { return count_ < ring_.size(); });
+        }
+        auto& slot = ring_[(head_ + count_) % ring_.size()];
+        lock.unlock();
+
+        // 写线程只会读取已提交的槽位，这里可以不加锁拷贝
+        slot.pixels.assign(pixels.begin(), pixels.end());
+        slot.w = w;
+        slot.h = h;
+
+        lock.lock();
+        count_++;
+        lock.unlock();
+        cond_.notify_all();
+        return true;
+    }
+
+    uint64_t DroppedFrames() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+   private:
+    struct Slot {
+        std::vector<uint32_t> pixels;
+        uint32_t w = 0;
+        uint32_t h = 0;
+    };
+
+    std::unique_ptr<IOutputSink> sink_;
+    std::vector<Slot> ring_;
+    OverflowPolicy policy_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint64_t dropped_ = 0;
+    bool stop_ = false;
+    bool failed_ = false;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread thread_;
+
+    void writeLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [this]() { return count_ > 0 || stop_; });
+            if (count_ == 0) {
+                break;
+            }
+            auto& slot = ring_[head_];
+            lock.unlock();
+            bool ok = failed_ || sink_->Write(slot.pixels, slot.w, slot.h);
+            lock.lock();
+            if (!ok && !failed_) {
+                SDL_Log("write frame to output sink failed");
+                failed_ = true;
+            }
+            head_ = (head_ + 1) % ring_.size();
+            count_--;
+            cond_.notify_all();
+        }
+    }
+};
+
+// format: y4m 或 rgb
+std::unique_ptr<IOutputSink> CreateOutputSink(const std::string &format,
+                                              const std::string &path,
+                                              uint32_t fps) {
+    int fd = OpenOutputFd(path);
+    if (fd < 0) {
+        SDL_Log("open %s failed", path.c_str());
+        return nullptr;
+    }
+    if (format == "rgb") {
+        return std::make_unique<RawRGBSink>(fd);
+    }
+    return std::make_unique<Y4MSink>(fd, fps);
+}
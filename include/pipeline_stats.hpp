@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// 渲染管线各阶段的计数，从上一次Clear(或ResetStats)开始累计
+// GPU渲染器逐像素判断近平面，不做三角形级的视锥剔除和裁剪，对应的几项为0
+struct PipelineStats {
+    uint64_t verticesShaded = 0;
+    uint64_t trianglesSubmitted = 0;
+    uint64_t trianglesBackfaceCulled = 0;
+    uint64_t trianglesFrustumCulled = 0;
+    // 跨过视锥边界需要裁剪的三角形数，以及裁剪后生成的三角形数
+    uint64_t trianglesClipped = 0;
+    uint64_t trianglesGenerated = 0;
+    uint64_t pixelsDepthTested = 0;
+    uint64_t pixelsDepthPassed = 0;
+    uint64_t pixelsShaded = 0;
+    // 画布的像素数，用于计算overdraw
+    uint64_t canvasPixels = 0;
+
+    // 平均每个屏幕像素执行像素着色的次数
+    double Overdraw() const {
+        return canvasPixels > 0 ? double(pixelsShaded) / canvasPixels : 0.0;
+    }
+
+    PipelineStats &operator+=(const PipelineStats &other) {
+        verticesShaded += other.verticesShaded;
+        trianglesSubmitted += other.trianglesSubmitted;
+        trianglesBackfaceCulled += other.trianglesBackfaceCulled;
+        trianglesFrustumCulled += other.trianglesFrustumCulled;
+        trianglesClipped += other.trianglesClipped;
+        trianglesGenerated += other.trianglesGenerated;
+        pixelsDepthTested += other.pixelsDepthTested;
+        pixelsDepthPassed += other.pixelsDepthPassed;
+        pixelsShaded += other.pixelsShaded;
+        return *this;
+    }
+
+    // 标题栏里显示的简短版本
+    std::string Summary() const {
+        char text[160];
+        snprintf(text, sizeof(text),
+                 "tri %" PRIu64 " (culled %" PRIu64 ") px %" PRIu64
+                 " overdraw %.2f",
+                 trianglesSubmitted,
+                 trianglesBackfaceCulled + trianglesFrustumCulled,
+                 pixelsShaded, Overdraw());
+        return text;
+    }
+
+    static const char *CsvHeader() {
+        return "frame,vertices_shaded,triangles_submitted,"
+               "triangles_backface_culled,triangles_frustum_culled,"
+               "triangles_clipped,triangles_generated,pixels_depth_tested,"
+               "pixels_depth_passed,pixels_shaded,overdraw";
+    }
+
+    void WriteCsvRow(FILE *file, uint32_t frame) const {
+        fprintf(file,
+                "%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.4f\n",
+                frame, verticesShaded, trianglesSubmitted,
+                trianglesBackfaceCulled, trianglesFrustumCulled,
+                trianglesClipped, trianglesGenerated, pixelsDepthTested,
+                pixelsDepthPassed, pixelsShaded, Overdraw());
+    }
+};
+
+// 多个任务共同累计的统计：每个任务先在自己的局部变量里计数，结束时合并一次，
+// 热循环里不碰共享数据
+class SharedPipelineStats {
+   public:
+    void Merge(const PipelineStats &local) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_ += local;
+    }
+
+    PipelineStats Get() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_ = PipelineStats{};
+    }
+
+   private:
+    std::mutex mutex_;
+    PipelineStats total_;
+};
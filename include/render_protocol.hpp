@@ -0,0 +1,239 @@
+#pragma once
+
+// 本地渲染服务的协议：Unix domain socket上传定长的请求/应答，
+// 图像通过共享内存返回，不经过socket拷贝
+// 这个头文件不依赖SDL，客户端程序可以单独使用
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+const uint32_t RENDER_PROTOCOL_MAGIC = 0x53524E44;  // "SRND"
+const size_t SHM_NAME_LENGTH = 64;
+
+enum class ImageFormat : uint32_t {
+    ARGB8888 = 0,  // 帧缓冲原样输出(FRAMEBUFFER_FORMAT)
+    RGB24 = 1,
+};
+
+enum class RenderStatus : uint32_t {
+    Ok = 0,
+    BadRequest = 1,
+    ModelLoadFailed = 2,
+    OutOfMemory = 3,
+};
+
+struct RenderRequest {
+    uint32_t magic = RENDER_PROTOCOL_MAGIC;
+    uint32_t model = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    ImageFormat format = ImageFormat::ARGB8888;
+    float fov = 60.0f;  // 角度
+    float cameraPosition[3] = {0.0f, 1.0f, 0.0f};
+    float cameraRotation[3] = {0.0f, 0.0f, 0.0f};  // 弧度
+    float modelRotation = 0.0f;                    // 绕y轴，角度
+};
+
+struct RenderResponse {
+    uint32_t magic = RENDER_PROTOCOL_MAGIC;
+    RenderStatus status = RenderStatus::Ok;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    ImageFormat format = ImageFormat::ARGB8888;
+    // 图像在共享内存中的大小，共享内存本身可能更大
+    uint64_t imageSize = 0;
+    // 共享内存的总大小，变化时客户端需要重新映射
+    uint64_t shmSize = 0;
+    // 请求在队列中等待和渲染的时间
+    double queueMs = 0.0;
+    double renderMs = 0.0;
+    char shmName[SHM_NAME_LENGTH] = {};
+};
+
+inline size_t BytesPerPixel(ImageFormat format) {
+    return format == ImageFormat::RGB24 ? 3 : 4;
+}
+
+inline bool SendAll(int fd, const void *data, size_t size) {
+    auto ptr = (const uint8_t *)data;
+    while (size > 0) {
+        auto n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool RecvAll(int fd, void *data, size_t size) {
+    auto ptr = (uint8_t *)data;
+    while (size > 0) {
+        auto n = recv(fd, ptr, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool FillSocketAddress(const std::string &path, sockaddr_un &addr) {
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+// 服务端每个连接一块共享内存，按需扩大
+class SharedImageBuffer {
+   public:
+    explicit SharedImageBuffer(const std::string &name) : name_(name) {}
+
+    ~SharedImageBuffer() {
+        if (data_) {
+            munmap(data_, size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            shm_unlink(name_.c_str());
+        }
+    }
+
+    SharedImageBuffer(const SharedImageBuffer &) = delete;
+    SharedImageBuffer &operator=(const SharedImageBuffer &) = delete;
+
+    // 保证至少有size字节，只在变大时重新映射
+    bool Reserve(size_t size) {
+        if (size <= size_) {
+            return true;
+        }
+        if (fd_ < 0) {
+            fd_ = shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+            if (fd_ < 0) {
+                return false;
+            }
+        }
+        if (data_) {
+            munmap(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+        if (ftruncate(fd_, size) != 0) {
+            return false;
+        }
+        auto data =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        data_ = (uint8_t *)data;
+        size_ = size;
+        return true;
+    }
+
+    uint8_t *Data() { return data_; }
+    size_t Size() const { return size_; }
+    const std::string &Name() const { return name_; }
+
+   private:
+    std::string name_;
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 客户端：同步地发请求、等应答，图像直接从共享内存读取
+class RenderClient {
+   public:
+    RenderClient() {}
+
+    ~RenderClient() {
+        unmap();
+        if (socket_ >= 0) {
+            close(socket_);
+        }
+    }
+
+    RenderClient(const RenderClient &) = delete;
+    RenderClient &operator=(const RenderClient &) = delete;
+
+    bool Connect(const std::string &path) {
+        sockaddr_un addr;
+        if (!FillSocketAddress(path, addr)) {
+            return false;
+        }
+        socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_ < 0) {
+            return false;
+        }
+        return connect(socket_, (sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+
+    // 成功时image指向共享内存中的图像，在下一次Render之前有效
+    bool Render(const RenderRequest &request, RenderResponse &response,
+                const uint8_t *&image) {
+        image = nullptr;
+        if (!SendAll(socket_, &request, sizeof(request)) ||
+            !RecvAll(socket_, &response, sizeof(response)) ||
+            response.magic != RENDER_PROTOCOL_MAGIC) {
+            return false;
+        }
+        if (response.status != RenderStatus::Ok) {
+            return true;
+        }
+        response.shmName[SHM_NAME_LENGTH - 1] = '\0';
+        if (!mapShared(response.shmName, response.shmSize)) {
+            return false;
+        }
+        image = data_;
+        return true;
+    }
+
+   private:
+    int socket_ = -1;
+    std::string shmName_;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    bool mapShared(const std::string &name, size_t size) {
+        if (data_ && name == shmName_ && size == size_) {
+            return true;
+        }
+        unmap();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        data_ = (const uint8_t *)data;
+        size_ = size;
+        shmName_ = name;
+        return true;
+    }
+
+    void unmap() {
+        if (data_) {
+            munmap((void *)data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <poll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "render_protocol.hpp"
+#include "renderer_factory.hpp"
+#include "scene.hpp"
+
+// 本地渲染服务
+// 模型和纹理第一次被请求时加载，之后常驻内存；
+// 连接线程把请求放进队列，由固定数量的工作线程(各自持有IRenderer)渲染，
+// 结果写进该连接的共享内存
+class RenderServer {
+   public:
+    // 单边最大分辨率，防止一个请求申请过多内存
+    static constexpr uint32_t MAX_RESOLUTION = 8192;
+
+    // workers为0时使用全部硬件线程
+    RenderServer(std::vector<ModelFileInfo> models, uint32_t workers = 0,
+                 SceneLoadOptions loadOptions = SceneLoadOptions{})
+        : models_(models),
+          scenes_(models.size()),
+          loadOptions_(loadOptions),
+          workerCount_(workers) {
+        if (workerCount_ == 0) {
+            workerCount_ = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    ~RenderServer() { Stop(); }
+
+    // 阻塞直到Stop被调用，Stop可以在信号处理函数里调用
+    bool Run(const std::string &socketPath) {
+        sockaddr_un addr;
+        if (!FillSocketAddress(socketPath, addr)) {
+            SDL_Log("socket path too long: %s", socketPath.c_str());
+            return false;
+        }
+        listen_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socketPath.c_str());
+        if (listen_ < 0 || bind(listen_, (sockaddr *)&addr, sizeof(addr)) ||
+            listen(listen_, 64)) {
+            SDL_Log("listen on %s failed", socketPath.c_str());
+            return false;
+        }
+        for (uint32_t i = 0; i < workerCount_; i++) {
+            workers_.emplace_back([this]() { workLoop(); });
+        }
+        SDL_Log("render server listening on %s with %u workers",
+                socketPath.c_str(), workerCount_);
+
+        std::list<Connection> connections;
+        while (!stopping_) {
+            reapConnections(connections);
+            pollfd pfd = {listen_, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+            int client = accept(listen_, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(clientMutex_);
+                clients_.insert(client);
+            }
+            auto &connection = connections.emplace_back();
+            connection.thread = std::thread([this, client, &connection]() {
+                serveConnection(client);
+                connection.done = true;
+            });
+        }
+
+        // 断开所有连接，等连接线程退出后再停工作线程
+        {
+            std::lock_guard<std::mutex> lock(clientMutex_);
+            for (auto client : clients_) {
+                shutdown(client, SHUT_RDWR);
+            }
+        }
+        for (auto &connection : connections) {
+            connection.thread.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            stopWorkers_ = true;
+        }
+        queueCond_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+        workers_.clear();
+        close(listen_);
+        listen_ = -1;
+        unlink(socketPath.c_str());
+        SDL_Log("render server stopped");
+        return true;
+    }
+
+    void Stop() { stopping_ = true; }
+
+   private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // 连接线程结束时标记done，接受循环里回收
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    struct Job {
+        RenderRequest request;
+        RenderResponse response;
+        SharedImageBuffer *output;
+        Clock::time_point enqueued;
+        bool done = false;
+    };
+
+    std::vector<ModelFileInfo> models_;
+    // 每个模型的加载结果，第一个请求的线程负责加载，其他请求等同一个结果
+    std::vector<std::shared_future<std::shared_ptr<const Scene>>> scenes_;
+    std::mutex sceneMutex_;
+    SceneLoadOptions loadOptions_;
+    uint32_t workerCount_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stopping_{false};
+    int listen_ = -1;
+
+    std::mutex queueMutex_;
+    std::condition_variable queueCond_;
+    std::condition_variable doneCond_;
+    std::deque<Job *> queue_;
+    bool stopWorkers_ = false;
+
+    std::mutex clientMutex_;
+    std::set<int> clients_;
+    std::atomic<uint32_t> connectionId_{0};
+
+    // 已经结束的连接线程，join后释放
+    static void reapConnections(std::list<Connection> &connections) {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->done) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // 常驻模型，加载失败时下次请求会重试
+    // 锁只保护查找，加载在锁外进行，不会挡住其他模型的请求
+    std::shared_ptr<const Scene> getScene(uint32_t model) {
+        std::promise<std::shared_ptr<const Scene>> loaded;
+        std::shared_future<std::shared_ptr<const Scene>> scene;
+        bool load = false;
+        {
+            std::lock_guard<std::mutex> lock(sceneMutex_);
+            auto &cached = scenes_[model];
+            if (!cached.valid() || loadFailed(cached)) {
+                cached = loaded.get_future().share();
+                load = true;
+            }
+            scene = cached;
+        }
+        if (load) {
+            // 加载抛出的异常交给所有等待这个模型的请求
+            try {
+                loaded.set_value(Scene::Load(models_[model], loadOptions_));
+            } catch (...) {
+                loaded.set_exception(std::current_exception());
+            }
+        }
+        return scene.get();
+    }
+
+    // 加载完成但是失败了(返回空或者抛出异常)，下一个请求重新加载
+    static bool loadFailed(
+        const std::shared_future<std::shared_ptr<const Scene>> &scene) {
+        if (scene.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            return false;
+        }
+        try {
+            return !scene.get();
+        } catch (...) {
+            return true;
+        }
+    }
+
+    void serveConnection(int client) {
+        char name[SHM_NAME_LENGTH];
+        snprintf(name, sizeof(name), "/softrender-%d-%u", (int)getpid(),
+                 connectionId_++);
+        SharedImageBuffer output(name);
+        Job job;
+        job.output = &output;
+        while (RecvAll(client, &job.request, sizeof(job.request))) {
+            job.response = RenderResponse{};
+            job.done = false;
+            job.enqueued = Clock::now();
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                queue_.push_back(&job);
+                queueCond_.notify_one();
+                doneCond_.wait(lock, [&]() { return job.done; });
+            }
+            if (!SendAll(client, &job.response, sizeof(job.response))) {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(clientMutex_);
+        clients_.erase(client);
+        close(client);
+    }
+
+    void workLoop() {
+        // 每个工作线程只保留一个渲染器，分辨率变化时重新创建
+        std::unique_ptr<IRenderer> renderer;
+        CommandBuffer commands(UNIFORM_TEXTURE);
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        while (true) {
+            queueCond_.wait(
+                lock, [this]() { return !queue_.empty() || stopWorkers_; });
+            if (queue_.empty()) {
+                break;
+            }
+            auto job = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+
+            auto start = Clock::now();
+            job->response.status = render(*job, renderer, commands);
+            auto end = Clock::now();
+            job->response.queueMs =
+                std::chrono::duration<double, std::milli>(start - job->enqueued)
+                    .count();
+            job->response.renderMs =
+                std::chrono::duration<double, std::milli>(end - start).count();
+
+            lock.lock();
+            job->done = true;
+            doneCond_.notify_all();
+        }
+    }
+
+    // 视角在(0, 180)度之间，相机和模型的参数都是有限值
+    static bool validCamera(const RenderRequest &request) {
+        if (!std::isfinite(request.fov) || request.fov <= 0.0f ||
+            request.fov >= 180.0f || !std::isfinite(request.modelRotation)) {
+            return false;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (!std::isfinite(request.cameraPosition[i]) ||
+                !std::isfinite(request.cameraRotation[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    RenderStatus render(Job &job, std::unique_ptr<IRenderer> &renderer,
+                        CommandBuffer &commands) {
+        auto &request = job.request;
+        auto &response = job.response;
+        if (request.magic != RENDER_PROTOCOL_MAGIC ||
+            request.model >= models_.size() || request.width == 0 ||
+            request.height == 0 || request.width > MAX_RESOLUTION ||
+            request.height > MAX_RESOLUTION ||
+            request.format > ImageFormat::RGB24 || !validCamera(request)) {
+            return RenderStatus::BadRequest;
+        }
+        std::shared_ptr<const Scene> scene;
+        try {
+            scene = getScene(request.model);
+        } catch (const std::exception &e) {
+            SDL_Log("load model %u failed: %s", request.model, e.what());
+        } catch (...) {
+            SDL_Log("load model %u failed", request.model);
+        }
+        if (!scene) {
+            return RenderStatus::ModelLoadFailed;
+        }
+
+        auto w = request.width;
+        auto h = request.height;
+        auto camera = Camera{1.0, 1000.0, 1.0f * w / h, Radians(request.fov)};
+        camera.MoveTo(Vec3{request.cameraPosition[0],
+                           request.cameraPosition[1],
+                           request.cameraPosition[2]});
+        camera.SetRotation(Vec3{request.cameraRotation[0],
+                                request.cameraRotation[1],
+                                request.cameraRotation[2]});
+        if (!renderer || renderer->GetCanvaWidth() != w ||
+            renderer->GetCanvaHeight() != h) {
+            // 先释放旧的附件再分配新的
+            renderer.reset();
+            renderer = CreateRenderer(w, h, camera);
+            SetupRenderer(*renderer);
+        }
+        renderer->SetCamera(camera);
+        auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+        renderer->Clear(clearColor);
+        renderer->ClearDepth();
+        auto model = CreateTurntableModel(request.modelRotation);
+        scene->Draw(*renderer, model, commands);
+
+        auto pixels = renderer->GetRenderedImage();
+        size_t imageSize = size_t(w) * h * BytesPerPixel(request.format);
+        if (!job.output->Reserve(imageSize)) {
+            return RenderStatus::OutOfMemory;
+        }
+        auto dst = job.output->Data();
+        if (request.format == ImageFormat::RGB24) {
+            for (size_t i = 0; i < pixels.size(); i++) {
+                auto pixel = pixels[i];
+                dst[i * 3] = (pixel >> 16) & 0xFF;
+                dst[i * 3 + 1] = (pixel >> 8) & 0xFF;
+                dst[i * 3 + 2] = pixel & 0xFF;
+            }
+        } else {
+            memcpy(dst, pixels.data(), imageSize);
+        }
+
+        response.width = w;
+        response.height = h;
+        response.format = request.format;
+        response.imageSize = imageSize;
+        response.shmSize = job.output->Size();
+        strncpy(response.shmName, job.output->Name().c_str(),
+                SHM_NAME_LENGTH - 1);
+        return RenderStatus::Ok;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "base_renderer.hpp"
+#include "cpu_renderer.hpp"
+#include "gpu_renderer.hpp"
+
+// 光栅化后端，两种渲染器都编译进来，运行时选择，投影约定相同
+// Gpu: 遍历包围盒、用重心坐标判断；Cpu: 拆成梯形按扫描线填充，
+// 带三角形级的视锥剔除和裁剪；Auto: Gpu的流程，按三角形在屏幕上的大小
+// 选择包围盒遍历或扫描线
+enum class RendererBackend {
+    Gpu,
+    Cpu,
+    Auto,
+};
+
+inline const char *RendererBackendName(RendererBackend backend) {
+    switch (backend) {
+        case RendererBackend::Gpu:
+            return "gpu";
+        case RendererBackend::Cpu:
+            return "cpu";
+        case RendererBackend::Auto:
+            return "auto";
+    }
+    return "";
+}
+
+// 按键循环切换时的下一个后端
+inline RendererBackend NextRendererBackend(RendererBackend backend) {
+    return backend == RendererBackend::Auto
+               ? RendererBackend::Gpu
+               : RendererBackend(static_cast<int>(backend) + 1);
+}
+
+// 命令行的名字：gpu、cpu、auto
+inline std::optional<RendererBackend> ParseRendererBackend(
+    const std::string &name) {
+    if (name == "gpu") {
+        return RendererBackend::Gpu;
+    } else if (name == "cpu") {
+        return RendererBackend::Cpu;
+    } else if (name == "auto") {
+        return RendererBackend::Auto;
+    }
+    return std::nullopt;
+}
+
+std::unique_ptr<IRenderer> CreateRenderer(
+    uint32_t w, uint32_t h, Camera camera,
+    RendererBackend backend = RendererBackend::Gpu) {
+    switch (backend) {
+        case RendererBackend::Cpu:
+            return std::make_unique<CpuRenderer>(w, h, camera);
+        case RendererBackend::Auto:
+            return std::make_unique<GpuRenderer>(w, h, camera, true);
+        default:
+            return std::make_unique<GpuRenderer>(w, h, camera);
+    }
+}
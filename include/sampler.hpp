@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "math.hpp"
+#include "texture.hpp"
+
+enum class TextureFilter { Nearest, Linear };
+
+enum class AddressMode { Repeat, MirroredRepeat, ClampToEdge, ClampToBorder };
+
+// 向下取整，避免std::floor的函数调用
+inline int FloorToInt(float value) {
+    int i = (int)value;
+    return i - (value < i);
+}
+
+// 纹素寻址，按寻址模式以及纹理尺寸是否为2的幂在编译期特化
+// 所有分支都在编译期决定，运行时只有整数运算和min/max
+template <AddressMode Mode, bool Pow2>
+struct TexelAddress;
+
+template <bool Pow2>
+struct TexelAddress<AddressMode::Repeat, Pow2> {
+    static constexpr bool HasBorder = false;
+    static int Wrap(int i, int size, uint32_t mask) {
+        if constexpr (Pow2) {
+            return i & mask;
+        } else {
+            int r = i % size;
+            // 负数取模后再加一个周期
+            return r + ((r >> 31) & size);
+        }
+    }
+};
+
+template <bool Pow2>
+struct TexelAddress<AddressMode::MirroredRepeat, Pow2> {
+    static constexpr bool HasBorder = false;
+    static int Wrap(int i, int size, uint32_t) {
+        int period = size * 2;
+        int r;
+        if constexpr (Pow2) {
+            r = i & (period - 1);
+        } else {
+            r = i % period;
+            r += (r >> 31) & period;
+        }
+        // 后半个周期是镜像
+        return std::min(r, period - 1 - r);
+    }
+};
+
+template <bool Pow2>
+struct TexelAddress<AddressMode::ClampToEdge, Pow2> {
+    static constexpr bool HasBorder = false;
+    static int Wrap(int i, int size, uint32_t) {
+        return std::min(std::max(i, 0), size - 1);
+    }
+};
+
+template <bool Pow2>
+struct TexelAddress<AddressMode::ClampToBorder, Pow2> {
+    static constexpr bool HasBorder = true;
+    static int Wrap(int i, int size, uint32_t) {
+        return std::min(std::max(i, 0), size - 1);
+    }
+};
+
+template <AddressMode U, AddressMode V, bool Pow2>
+Color4 FetchTexel(const Texture &texture, int x, int y, const Color4 &border) {
+    using AddrU = TexelAddress<U, Pow2>;
+    using AddrV = TexelAddress<V, Pow2>;
+    int w = texture.Width();
+    int h = texture.Height();
+    auto color = texture.Fetch(AddrU::Wrap(x, w, texture.WidthMask()),
+                               AddrV::Wrap(y, h, texture.HeightMask()));
+    if constexpr (AddrU::HasBorder || AddrV::HasBorder) {
+        bool inside = (!AddrU::HasBorder || (uint32_t)x < (uint32_t)w) &&
+                      (!AddrV::HasBorder || (uint32_t)y < (uint32_t)h);
+        return inside ? color : border;
+    } else {
+        return color;
+    }
+}
+
+template <AddressMode U, AddressMode V, TextureFilter Filter, bool Pow2>
+Color4 SampleTexture(const Texture &texture, const Vec2 &texcoord,
+                     const Color4 &border) {
+    float u = texcoord.x * texture.Width();
+    float v = texcoord.y * texture.Height();
+    if constexpr (Filter == TextureFilter::Nearest) {
+        return FetchTexel<U, V, Pow2>(texture, FloorToInt(u), FloorToInt(v),
+                                      border);
+    } else {
+        // 以纹素中心为准做双线性插值
+        u -= 0.5f;
+        v -= 0.5f;
+        int x0 = FloorToInt(u);
+        int y0 = FloorToInt(v);
+        float tx = u - x0;
+        float ty = v - y0;
+        auto c00 = FetchTexel<U, V, Pow2>(texture, x0, y0, border);
+        auto c10 = FetchTexel<U, V, Pow2>(texture, x0 + 1, y0, border);
+        auto c01 = FetchTexel<U, V, Pow2>(texture, x0, y0 + 1, border);
+        auto c11 = FetchTexel<U, V, Pow2>(texture, x0 + 1, y0 + 1, border);
+        return Lerp(Lerp(c00, c10, tx), Lerp(c01, c11, tx), ty);
+    }
+}
+
+// 采样器对象：过滤方式、每个轴的寻址模式和边框颜色
+// 和纹理一样按槽位绑定到Uniforms上
+class Sampler {
+   public:
+    using SampleFunc = Color4 (*)(const Texture &, const Vec2 &,
+                                  const Color4 &);
+
+    Color4 borderColor;
+
+    Sampler(TextureFilter filter = TextureFilter::Nearest,
+            AddressMode addressU = AddressMode::Repeat,
+            AddressMode addressV = AddressMode::Repeat,
+            Color4 borderColor = Vec4::Zero)
+        : borderColor(borderColor),
+          filter_(filter),
+          addressU_(addressU),
+          addressV_(addressV),
+          sample_(resolveU(addressU, addressV, filter)) {}
+
+    TextureFilter Filter() const { return filter_; }
+    AddressMode AddressU() const { return addressU_; }
+    AddressMode AddressV() const { return addressV_; }
+
+    Color4 Sample(const Texture &texture, const Vec2 &texcoord) const {
+        return sample_[texture.IsPow2()](texture, texcoord, borderColor);
+    }
+
+   private:
+    TextureFilter filter_;
+    AddressMode addressU_;
+    AddressMode addressV_;
+    // [0]: 任意尺寸，[1]: 宽高都是2的幂
+    std::array<SampleFunc, 2> sample_;
+
+    template <AddressMode U, AddressMode V, TextureFilter Filter>
+    static std::array<SampleFunc, 2> resolve() {
+        return {&SampleTexture<U, V, Filter, false>,
+                &SampleTexture<U, V, Filter, true>};
+    }
+
+    template <AddressMode U, AddressMode V>
+    static std::array<SampleFunc, 2> resolveFilter(TextureFilter filter) {
+        switch (filter) {
+            case TextureFilter::Linear:
+                return resolve<U, V, TextureFilter::Linear>();
+            default:
+                return resolve<U, V, TextureFilter::Nearest>();
+        }
+    }
+
+    template <AddressMode U>
+    static std::array<SampleFunc, 2> resolveV(AddressMode v,
+                                              TextureFilter filter) {
+        switch (v) {
+            case AddressMode::MirroredRepeat:
+                return resolveFilter<U, AddressMode::MirroredRepeat>(filter);
+            case AddressMode::ClampToEdge:
+                return resolveFilter<U, AddressMode::ClampToEdge>(filter);
+            case AddressMode::ClampToBorder:
+                return resolveFilter<U, AddressMode::ClampToBorder>(filter);
+            default:
+                return resolveFilter<U, AddressMode::Repeat>(filter);
+        }
+    }
+
+    static std::array<SampleFunc, 2> resolveU(AddressMode u, AddressMode v,
+                                              TextureFilter filter) {
+        switch (u) {
+            case AddressMode::MirroredRepeat:
+                return resolveV<AddressMode::MirroredRepeat>(v, filter);
+            case AddressMode::ClampToEdge:
+                return resolveV<AddressMode::ClampToEdge>(v, filter);
+            case AddressMode::ClampToBorder:
+                return resolveV<AddressMode::ClampToBorder>(v, filter);
+            default:
+                return resolveV<AddressMode::Repeat>(v, filter);
+        }
+    }
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <optional>
+#include <span>
 #include <tuple>
 
 #include "math.hpp"
@@ -26,8 +28,9 @@ class Trapezoid {
         : top(top), bottom(bottom), left(left), right(right) {}
 
     static std::tuple<std::optional<Trapezoid>, std::optional<Trapezoid>>
-    FromTriangle(std::vector<Vertex> vertices) {
-        assert(vertices.size() == 3);
+    FromTriangle(std::span<const Vertex> triangle) {
+        assert(triangle.size() == 3);
+        std::array<Vertex, 3> vertices{triangle[0], triangle[1], triangle[2]};
         std::sort(std::begin(vertices), std::end(vertices),
                   [](const Vertex& left, const Vertex& right) {
                       return left.position.y < right.position.y;
@@ -56,7 +59,7 @@ class Trapezoid {
             }
             Trapezoid trap = Trapezoid(
                 vertices[0].position.y, vertices[2].position.y,
-                Edge(vertices[0], vertices[2]), Edge(vertices[0], vertices[2]));
+                Edge(vertices[0], vertices[1]), Edge(vertices[0], vertices[2]));
             return {trap, std::nullopt};
         }
 
@@ -119,54 +122,65 @@ class Scanline {
         : vertex(vertex), step(step), y(y), width(width) {}
 };
 
-Vertex NearPlaneClipLine(Vertex& out, Vertex& inner, float nearPlaneZ) {
-    auto proportion =
-        (nearPlaneZ - inner.position.z) / (out.position.z - inner.position.z);
-    auto position =
-        proportion * (out.position - inner.position) + inner.position;
-    auto arrtibute = InterpAttributes(inner.attributes, out.attributes,
-                                      Lerp<float>, proportion);
-    return Vertex{position, arrtibute};
+// 裁剪空间的六个视锥平面：w+x、w-x、w+y、w-y、w+z、w-z都不小于0时在视锥内
+constexpr int CLIP_PLANE_COUNT = 6;
+
+// 点到第plane个平面的有向距离，小于0时在外侧
+inline float ClipPlaneDistance(const Vec4& p, int plane) {
+    switch (plane) {
+        case 0:
+            return p.w + p.x;
+        case 1:
+            return p.w - p.x;
+        case 2:
+            return p.w + p.y;
+        case 3:
+            return p.w - p.y;
+        case 4:
+            return p.w + p.z;
+        default:
+            return p.w - p.z;
+    }
 }
 
-std::tuple<std::array<Vertex, 3>, std::optional<std::array<Vertex, 3>>>
-NearPlaneClip(std::vector<Vertex>& vertices, float near) {
-    near = -near;
-    if (vertices[0].position.z > near) {
-        if (vertices[1].position.z > near) {
-            auto newVertex0 = NearPlaneClipLine(vertices[0], vertices[2], near);
-            auto newVertex1 = NearPlaneClipLine(vertices[1], vertices[2], near);
-            return {std::array<Vertex, 3>{newVertex0, newVertex1, vertices[2]},
-                    std::nullopt};
-        } else if (vertices[2].position.z > near) {
-            auto newVertex0 = NearPlaneClipLine(vertices[0], vertices[1], near);
-            auto newVertex2 = NearPlaneClipLine(vertices[2], vertices[1], near);
-            return {std::array<Vertex, 3>{newVertex0, vertices[1], newVertex2},
-                    std::nullopt};
-        } else {
-            auto newVertex1 = NearPlaneClipLine(vertices[0], vertices[1], near);
-            auto newVertex2 = NearPlaneClipLine(vertices[0], vertices[2], near);
-            return {
-                std::array<Vertex, 3>{vertices[1], newVertex2, newVertex1},
-                std::array<Vertex, 3>{vertices[1], vertices[2], newVertex2}};
+// 在第i个平面外侧时第i位为1
+inline uint32_t ClipOutcode(const Vec4& p) {
+    uint32_t code = 0;
+    for (int plane = 0; plane < CLIP_PLANE_COUNT; plane++) {
+        if (ClipPlaneDistance(p, plane) < 0.0f) {
+            code |= 1u << plane;
         }
-    } else if (vertices[1].position.z > near) {
-        if (vertices[2].position.z > near) {
-            auto newVertex1 = NearPlaneClipLine(vertices[1], vertices[0], near);
-            auto newVertex2 = NearPlaneClipLine(vertices[2], vertices[0], near);
-            return {std::array<Vertex, 3>{vertices[0], newVertex1, newVertex2},
-                    std::nullopt};
-        } else {
-            auto newVertex1 = NearPlaneClipLine(vertices[2], vertices[1], near);
-            auto newVertex2 = NearPlaneClipLine(vertices[0], vertices[1], near);
-            return {
-                std::array<Vertex, 3>{vertices[0], newVertex2, newVertex1},
-                std::array<Vertex, 3>{vertices[0], newVertex1, vertices[2]}};
+    }
+    return code;
+}
+
+// 三角形每被一个平面裁剪最多多出一个顶点
+using ClippedPolygon = FixedVector<Vertex, 3 + CLIP_PLANE_COUNT>;
+
+// Sutherland-Hodgman：依次用planes中的平面裁剪凸多边形，结果放回polygon，
+// 全部被裁掉时为空；position是裁剪空间的坐标，属性在裁剪空间里线性插值，
+// 透视除法之后仍然是透视正确的
+void ClipPolygon(ClippedPolygon& polygon, uint32_t planes) {
+    ClippedPolygon input;
+    for (int plane = 0; plane < CLIP_PLANE_COUNT && !polygon.empty();
+         plane++) {
+        if ((planes & (1u << plane)) == 0) {
+            continue;
+        }
+        input = polygon;
+        polygon.clear();
+        for (size_t i = 0; i < input.size(); i++) {
+            auto& current = input[i];
+            auto& next = input[(i + 1) % input.size()];
+            auto d0 = ClipPlaneDistance(current.position, plane);
+            auto d1 = ClipPlaneDistance(next.position, plane);
+            if (d0 >= 0.0f) {
+                polygon.push_back(current);
+            }
+            // 边穿过平面时加上交点
+            if ((d0 >= 0.0f) != (d1 >= 0.0f)) {
+                polygon.push_back(LerpVertex(current, next, d0 / (d0 - d1)));
+            }
         }
-    } else {
-        auto newVertex1 = NearPlaneClipLine(vertices[2], vertices[0], near);
-        auto newVertex2 = NearPlaneClipLine(vertices[2], vertices[1], near);
-        return {std::array<Vertex, 3>{vertices[0], newVertex2, newVertex1},
-                std::array<Vertex, 3>{vertices[0], vertices[1], newVertex2}};
     }
 }
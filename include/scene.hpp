@@ -0,0 +1,429 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "base_renderer.hpp"
+#include "command_buffer.hpp"
+#include "mesh_cache.hpp"
+#include "model.hpp"
+#include "obj_loader.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+
+// attribute location
+const size_t ATTR_TEXCOORD = 0;  // vec2
+const size_t ATTR_NORMAL = 0;    // vec3
+
+// uniforms location
+const uint32_t UNIFORM_TEXTURE = 0;  // vec2
+const uint32_t UNIFORM_COLOR = 1;    // vec4
+
+struct ModelFileInfo {
+    std::string path;
+    std::string name;
+};
+
+// resources目录下自带的模型，窗口程序按1~4切换
+const std::vector<ModelFileInfo> MODEL_FILES = {
+    {"Red", "Red.obj"},
+    {"Son Goku", "Goku.obj"},
+    {"cube", "cube.obj"},
+    {"plane", "plane.obj"},
+};
+
+// 模型的短名，用在基准和参考图的名字里，比如"Son Goku"是"son_goku"
+std::string ModelSlug(const ModelFileInfo& fileInfo) {
+    std::string slug;
+    for (char c : fileInfo.path) {
+        slug.push_back(c == ' ' ? '_' : std::tolower((unsigned char)c));
+    }
+    return slug;
+}
+
+Camera CreateDefaultCamera(uint32_t w, uint32_t h) {
+    auto camera = Camera{1.0, 1000.0, 1.0f * w / h, Radians(60.0f)};
+    camera.MoveTo(Vec3{0.0, 1.0, 0.0});
+    camera.SetRotation(Vec3{Radians(1.0f), 0.0, 0.0});
+    return camera;
+}
+
+// 模型放在相机前方，绕y轴旋转rotation度
+Mat44 CreateTurntableModel(float rotation) {
+    return CreateTranslate(Vec3{0.0, 0.0, -4.0}) *
+           CreateEularRotate_y(Radians(rotation));
+}
+
+struct SceneLoadOptions {
+    // 从OBJ加载时中间数据的内存上限(字节)，0表示不限制
+    size_t memoryLimit = 0;
+    // 加载进度(0~1)，可能在加载线程上调用；返回false时取消加载
+    std::function<bool(float)> onProgress;
+    // 网格缓存所在的目录，空表示放在OBJ文件旁边
+    std::string cacheDir;
+};
+
+// 一个mesh绘制需要的全部数据，材质在加载时就已经解析好
+// vertices指向映射的缓存文件或者Scene自己的顶点缓冲
+struct SceneMesh {
+    std::span<const Vertex> vertices;
+    std::optional<Vec4> color;
+    std::optional<uint32_t> texture;  // TextureStorage中的id
+    Vec3 boundsMin;
+    Vec3 boundsMax;
+};
+
+// 一个模型加载后的全部数据(顶点、材质、纹理)
+// 加载完成后只读，可以在多个渲染器、多个线程之间共享
+class Scene {
+   public:
+    std::vector<SceneMesh> meshes;
+    TextureStorage textureStorage;
+
+    // 优先使用源文件旁边(或options.cacheDir下)的二进制缓存，
+    // 没有或者过期时解析OBJ并重新生成缓存
+    static std::shared_ptr<Scene> Load(
+        const ModelFileInfo& fileInfo,
+        const SceneLoadOptions& options = SceneLoadOptions{}) {
+        auto scene = std::make_shared<Scene>();
+        scene->onProgress_ = options.onProgress;
+        std::string MODEL_ROOT_DIR = "./resources/" + fileInfo.path;
+        auto modelPath =
+            std::filesystem::path{MODEL_ROOT_DIR}.append(fileInfo.name);
+        auto cachePath = MeshCachePath(modelPath);
+        if (!options.cacheDir.empty()) {
+            // 按模型所在的目录分开，不同目录下的同名模型不会共用缓存
+            cachePath = MeshCachePath(std::filesystem::path{options.cacheDir} /
+                                      fileInfo.path / fileInfo.name);
+            std::error_code error;
+            std::filesystem::create_directories(cachePath.parent_path(),
+                                                error);
+        }
+        if (scene->cache_.Open(cachePath)) {
+            SDL_Log("load %s from mesh cache", fileInfo.name.c_str());
+            return scene->loadFromCache(MODEL_ROOT_DIR, 0.0f) ? scene
+                                                                : nullptr;
+        }
+
+        // 边解析边写缓存，写完再映射回来，全部顶点不需要同时留在内存里
+        MeshCacheWriter writer;
+        if (writer.Begin(cachePath)) {
+            bool writeFailed = false;
+            auto result = scene->streamFromObj(
+                modelPath, options,
+                [&](const MeshCacheMesh& record,
+                    std::span<const Vertex> vertices) {
+                    writeFailed = !writer.Append(record, vertices);
+                    return !writeFailed;
+                });
+            if (!result.ok && !writeFailed) {
+                SDL_Log("load model from %s failed: %s",
+                        MODEL_ROOT_DIR.c_str(), result.error.c_str());
+                return nullptr;
+            }
+            if (result.ok && writer.Finish(scene->dependencies_,
+                                           scene->textures_) &&
+                scene->cache_.Open(cachePath)) {
+                return scene->loadFromCache(MODEL_ROOT_DIR,
+                                            OBJ_PARSE_PROGRESS)
+                           ? scene
+                           : nullptr;
+            }
+            writer.Abort();
+        }
+
+        // 缓存写不了(比如目录只读)时，顶点保存在内存里
+        SDL_Log("write mesh cache %s failed", cachePath.string().c_str());
+        std::vector<MeshCacheMesh> records;
+        auto result = scene->streamFromObj(
+            modelPath, options,
+            [&](MeshCacheMesh record, std::span<const Vertex> vertices) {
+                record.firstVertex = scene->vertexStorage_.size();
+                record.vertexCount = vertices.size();
+                scene->vertexStorage_.insert(scene->vertexStorage_.end(),
+                                             vertices.begin(),
+                                             vertices.end());
+                records.push_back(record);
+                return true;
+            });
+        if (!result.ok) {
+            SDL_Log("load model from %s failed: %s", MODEL_ROOT_DIR.c_str(),
+                    result.error.c_str());
+            return nullptr;
+        }
+        std::vector<uint32_t> textureIds;
+        if (!scene->loadTextures(MODEL_ROOT_DIR, scene->textures_, textureIds,
+                                 OBJ_PARSE_PROGRESS)) {
+            return nullptr;
+        }
+        for (auto& record : records) {
+            scene->addMesh(
+                record,
+                std::span<const Vertex>(scene->vertexStorage_)
+                    .subspan(record.firstVertex, record.vertexCount),
+                textureIds);
+        }
+        return scene;
+    }
+
+    // 每个mesh录制成一条命令：在uniforms的基础上设置自己的材质，
+    // 深度取包围盒中心在view空间到相机的距离
+    void Record(CommandBuffer& commands, uint32_t pipeline,
+                const Uniforms& uniforms, const Camera& camera,
+                const Mat44& model) const {
+        auto modelView = camera.view_mat_ * model;
+        for (auto& mesh : meshes) {
+            auto center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            auto viewCenter =
+                modelView * Vec4{center.x, center.y, center.z, 1.0f};
+            // set data into uniform
+            auto& meshUniforms =
+                commands.Draw(pipeline, uniforms, model, mesh.vertices,
+                              textureStorage, -viewCenter.z);
+            if (mesh.color.has_value()) {
+                meshUniforms.varyingVec4[UNIFORM_COLOR] = mesh.color.value();
+            }
+            if (mesh.texture.has_value()) {
+                meshUniforms.varyingTexuture[UNIFORM_TEXTURE] =
+                    mesh.texture.value();
+            }
+        }
+    }
+
+    // 用渲染器当前的管线和uniform绘制所有mesh，不改变渲染器的状态
+    // 每帧都画的调用方传入自己保留的commands，录制时可以复用上一帧的内存
+    void Draw(IRenderer& renderer, Mat44& model, CommandBuffer& commands,
+              DrawOrder order = DrawOrder::FrontToBack) const {
+        commands.Reset();
+        auto pipeline = commands.CapturePipeline(renderer);
+        Record(commands, pipeline, renderer.GetUniforms(),
+               renderer.GetCamera(), model);
+        commands.Sort(order);
+        commands.Submit(renderer);
+    }
+
+    void Draw(IRenderer& renderer, Mat44& model,
+              DrawOrder order = DrawOrder::FrontToBack) const {
+        CommandBuffer commands(UNIFORM_TEXTURE);
+        Draw(renderer, model, commands, order);
+    }
+
+   private:
+    MeshCacheFile cache_;
+    // 缓存写不了时从OBJ构造的顶点，所有mesh连续存放
+    std::vector<Vertex> vertexStorage_;
+    // 从OBJ加载时收集的贴图和依赖文件，写进缓存
+    std::vector<std::string> textures_;
+    std::vector<std::filesystem::path> dependencies_;
+    std::function<bool(float)> onProgress_;
+    bool cancelled_ = false;
+
+    // 从OBJ加载时解析占的进度，剩下的是贴图
+    static constexpr float OBJ_PARSE_PROGRESS = 0.8f;
+
+    bool reportProgress(float progress) {
+        if (onProgress_ && !cancelled_ && !onProgress_(progress)) {
+            SDL_Log("scene load cancelled");
+            cancelled_ = true;
+        }
+        return !cancelled_;
+    }
+
+    // 贴图的进度从progress到1
+    bool loadTextures(const std::string& root,
+                      const std::vector<std::string>& names,
+                      std::vector<uint32_t>& ids, float progress) {
+        if (!reportProgress(progress)) {
+            return false;
+        }
+        std::vector<std::string> paths;
+        for (auto& name : names) {
+            paths.push_back(std::filesystem::path{root}.append(name).string());
+        }
+        textureStorage.LoadAll(paths, names);
+        for (auto& name : names) {
+            ids.push_back(textureStorage.GetId(name).value());
+        }
+        return reportProgress(1.0f);
+    }
+
+    void addMesh(const MeshCacheMesh& record, std::span<const Vertex> vertices,
+                 const std::vector<uint32_t>& textureIds) {
+        SceneMesh mesh;
+        mesh.vertices = vertices;
+        if (record.flags & MeshCacheMesh::HasColor) {
+            mesh.color = Vec4{record.color[0], record.color[1],
+                              record.color[2], record.color[3]};
+        }
+        if (record.flags & MeshCacheMesh::HasTexture) {
+            mesh.texture = textureIds[record.texture];
+        }
+        mesh.boundsMin = Vec3{record.boundsMin[0], record.boundsMin[1],
+                              record.boundsMin[2]};
+        mesh.boundsMax = Vec3{record.boundsMax[0], record.boundsMax[1],
+                              record.boundsMax[2]};
+        meshes.push_back(mesh);
+    }
+
+    bool loadFromCache(const std::string& root, float progress) {
+        std::vector<std::string> textures;
+        for (uint32_t i = 0; i < cache_.TextureCount(); i++) {
+            textures.push_back(std::string(cache_.Texture(i)));
+        }
+        std::vector<uint32_t> textureIds;
+        if (!loadTextures(root, textures, textureIds, progress)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cache_.MeshCount(); i++) {
+            auto& record = cache_.Mesh(i);
+            addMesh(record, cache_.Vertices(record), textureIds);
+        }
+        return true;
+    }
+
+    using MeshSink =
+        std::function<bool(const MeshCacheMesh&, std::span<const Vertex>)>;
+
+    // data prepare, from OBJ model
+    // 每解析完一个mesh就转换成渲染用的顶点交给sink，之后立即释放
+    objloader::StreamResult streamFromObj(
+        const std::filesystem::path& modelPath,
+        const SceneLoadOptions& options, const MeshSink& sink) {
+        textures_.clear();
+        std::vector<Vertex> vertices;
+        objloader::StreamOptions streamOptions;
+        streamOptions.memoryLimit = options.memoryLimit;
+        streamOptions.bytesPerOutputVertex = sizeof(Vertex);
+        streamOptions.onProgress = [this](size_t parsed, size_t total) {
+            return reportProgress(OBJ_PARSE_PROGRESS * parsed / total);
+        };
+        auto result = model::StreamFromFile(
+            modelPath.string(), streamOptions,
+            [&](const model::Mesh& mesh,
+                const std::vector<objloader::Mtllib>& mtllibs) {
+                MeshCacheMesh record = {};
+                auto boundsMin = Vec3{FLT_MAX, FLT_MAX, FLT_MAX};
+                auto boundsMax = Vec3{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                vertices.clear();
+                for (auto& modelVertex : mesh.vertices) {
+                    auto attr = Attributes();
+                    attr.varyingVec2[ATTR_TEXCOORD] = modelVertex.texcoord;
+                    attr.varyingVec3[ATTR_NORMAL] = modelVertex.normal;
+                    vertices.push_back(Vertex{modelVertex.position, attr});
+                    for (int i = 0; i < 3; i++) {
+                        boundsMin.data[i] = std::min(
+                            boundsMin.data[i], modelVertex.position.data[i]);
+                        boundsMax.data[i] = std::max(
+                            boundsMax.data[i], modelVertex.position.data[i]);
+                    }
+                }
+                for (int i = 0; i < 3; i++) {
+                    record.boundsMin[i] = boundsMin.data[i];
+                    record.boundsMax[i] = boundsMax.data[i];
+                }
+                resolveMaterial(mesh, mtllibs, record);
+                bool ok = sink(record, vertices);
+                if (vertices.capacity() > model::MAX_RETAINED_MESH_VERTICES) {
+                    vertices = std::vector<Vertex>();
+                }
+                return ok;
+            });
+        dependencies_.clear();
+        dependencies_.push_back(modelPath);
+        dependencies_.insert(dependencies_.end(), result.mtllibFiles.begin(),
+                             result.mtllibFiles.end());
+        if (result.ok) {
+            SDL_Log("parsed %s: %zu meshes, peak %.1f MB",
+                    modelPath.filename().string().c_str(), result.meshCount,
+                    result.peakMemory / 1048576.0);
+        }
+        return result;
+    }
+
+    void resolveMaterial(const model::Mesh& mesh,
+                         const std::vector<objloader::Mtllib>& mtllibs,
+                         MeshCacheMesh& record) {
+        if (!mesh.mtllib.has_value() || !mesh.material.has_value()) {
+            return;
+        }
+        auto& mtllib = mtllibs[mesh.mtllib.value()];
+        auto materialIt = mtllib.materials.find(mesh.material.value());
+        if (materialIt == mtllib.materials.end()) {
+            return;
+        }
+        auto& material = materialIt->second;
+        if (material.ambient.has_value()) {
+            auto ambient = material.ambient.value();
+            record.flags |= MeshCacheMesh::HasColor;
+            record.color[0] = ambient.x;
+            record.color[1] = ambient.y;
+            record.color[2] = ambient.z;
+            record.color[3] = 1.0f;
+        }
+        if (material.textureMaps.diffuse.has_value()) {
+            // 只加载用到的贴图
+            auto& diffuse = material.textureMaps.diffuse.value();
+            auto it = std::find(textures_.begin(), textures_.end(), diffuse);
+            if (it == textures_.end()) {
+                it = textures_.insert(textures_.end(), diffuse);
+            }
+            record.flags |= MeshCacheMesh::HasTexture;
+            record.texture = it - textures_.begin();
+        }
+    }
+};
+
+// 默认的渲染状态和着色器，窗口程序和批量渲染共用
+void SetupRenderer(IRenderer& renderer) {
+    renderer.SetFrontFace(FrontFace::CCW);
+    renderer.SetFaceCull(FaceCull::Back);
+    // 模型只占画面的一部分，背景块不需要每帧真正清除
+    renderer.SetLazyClear(true);
+    // OBJ的纹理坐标允许超出[0, 1]，按平铺处理
+    renderer.GetUniforms().varyingSampler[UNIFORM_TEXTURE] = Sampler{
+        TextureFilter::Nearest, AddressMode::Repeat, AddressMode::Repeat};
+    // 颜色和贴图槽位先放上默认值(白色、不绑定贴图)，和没有这两项时画出来一样；
+    // 每个mesh只改值不增删键，录制和提交时复制uniform就不用重新分配map节点
+    renderer.GetUniforms().varyingVec4[UNIFORM_COLOR] =
+        Vec4{1.0, 1.0, 1.0, 1.0};
+    renderer.GetUniforms().varyingTexuture[UNIFORM_TEXTURE] = NO_TEXTURE;
+
+    // vertex changing shader
+    renderer.GetShader().vertexChanging =
+        [](Vertex& vertex, Uniforms& Uniforms,
+           const TextureStorage& textureStorage) { return vertex; };
+    renderer.GetShader().pixelShading = [](Attributes& attr,
+                                           const Uniforms& uniforms,
+                                           const TextureStorage&
+                                               textureStorage) {
+        // 多个线程同时调用，只用find读uniforms，不能用会插入的operator[]
+        auto colorIt = uniforms.varyingVec4.find(UNIFORM_COLOR);
+        auto fragColor = colorIt == uniforms.varyingVec4.end()
+                             ? Vec4{1.0, 1.0, 1.0, 1.0}
+                             : colorIt->second;
+        auto texcoord = attr.varyingVec2[ATTR_TEXCOORD];
+        auto textureIt = uniforms.varyingTexuture.find(UNIFORM_TEXTURE);
+        if (textureIt != uniforms.varyingTexuture.end()) {
+            auto texturePtr = textureStorage.FindById(textureIt->second);
+            if (texturePtr) {
+                auto& texture = *texturePtr;
+                auto samplerIt = uniforms.varyingSampler.find(UNIFORM_TEXTURE);
+                if (samplerIt != uniforms.varyingSampler.end()) {
+                    fragColor *=
+                        TextureSample(texture, samplerIt->second, texcoord);
+                } else {
+                    fragColor *= TextureSample(texture, texcoord);
+                }
+            }
+        };
+        return fragColor;
+    };
+}
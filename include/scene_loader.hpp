@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "scene.hpp"
+
+struct SceneLoadStatus {
+    // 正在加载(或最近一次加载)的模型
+    std::string name;
+    bool loading = false;
+    // 0~1
+    float progress = 0.0f;
+    // 最近一次完成的加载用时和结果
+    double lastLoadMs = 0.0;
+    bool lastLoadFailed = false;
+};
+
+// 在后台线程上加载模型和贴图，生成完整的Scene
+// 渲染线程在帧之间用TakeLoaded取走新场景替换旧场景，加载期间继续画旧场景
+// 加载中又有新请求时，当前加载被取消，只保留最后一个请求
+class SceneLoader {
+   public:
+    explicit SceneLoader(SceneLoadOptions options = SceneLoadOptions{})
+        : options_(options) {
+        thread_ = std::thread([this]() { loadLoop(); });
+    }
+
+    ~SceneLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            pending_.reset();
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    SceneLoader(const SceneLoader&) = delete;
+    SceneLoader& operator=(const SceneLoader&) = delete;
+
+    void Request(const ModelFileInfo& fileInfo) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = fileInfo;
+            status_.name = fileInfo.name;
+            status_.loading = true;
+            progress_ = 0.0f;
+        }
+        cond_.notify_all();
+    }
+
+    // 有新加载完成的场景时返回它(只返回一次)，否则返回nullptr
+    std::shared_ptr<Scene> TakeLoaded() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(loaded_);
+    }
+
+    // 等待所有请求处理完
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return !pending_ && !busy_; });
+    }
+
+    SceneLoadStatus Status() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto status = status_;
+        status.progress = progress_;
+        return status;
+    }
+
+   private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    SceneLoadOptions options_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::optional<ModelFileInfo> pending_;
+    std::shared_ptr<Scene> loaded_;
+    SceneLoadStatus status_;
+    std::atomic<float> progress_{0.0f};
+    bool busy_ = false;
+    bool stopping_ = false;
+
+    void loadLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [this]() { return pending_ || stopping_; });
+            if (stopping_) {
+                break;
+            }
+            auto fileInfo = std::move(pending_.value());
+            pending_.reset();
+            busy_ = true;
+            lock.unlock();
+
+            auto options = options_;
+            // 有更新的请求或者要退出时取消当前加载
+            options.onProgress = [this](float progress) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_ || stopping_) {
+                    return false;
+                }
+                progress_ = progress;
+                return true;
+            };
+            auto start = Clock::now();
+            auto scene = Scene::Load(fileInfo, options);
+            std::chrono::duration<double, std::milli> elapse =
+                Clock::now() - start;
+
+            lock.lock();
+            busy_ = false;
+            // 被取消的加载不更新状态，新请求已经设置好了
+            if (!pending_ && !stopping_) {
+                status_.loading = false;
+                status_.lastLoadMs = elapse.count();
+                status_.lastLoadFailed = !scene;
+                if (scene) {
+                    progress_ = 1.0f;
+                    loaded_ = std::move(scene);
+                }
+                SDL_Log("load %s %s in %.1f ms", fileInfo.name.c_str(),
+                        status_.lastLoadFailed ? "failed" : "done",
+                        elapse.count());
+            }
+            cond_.notify_all();
+        }
+    }
+};
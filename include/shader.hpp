@@ -3,7 +3,9 @@
 #include <functional>
 #include <map>
 
+#include "fixed_vector.hpp"
 #include "math.hpp"
+#include "sampler.hpp"
 #include "texture.hpp"
 
 const size_t MAX_ATTRIBUTES_NUM = 4;
@@ -37,6 +39,8 @@ class Uniforms {
     std::map<unsigned int, Vec4> varyingVec4;
     std::map<unsigned int, Mat44> varyingMat44;
     std::map<unsigned int, unsigned int> varyingTexuture;
+    // 和varyingTexuture使用相同的槽位
+    std::map<unsigned int, Sampler> varyingSampler;
 
     void clear() {
         varyingInt.clear();
@@ -46,6 +50,7 @@ class Uniforms {
         varyingVec4.clear();
         varyingMat44.clear();
         varyingTexuture.clear();
+        varyingSampler.clear();
     }
 };
 
@@ -59,6 +64,9 @@ class Vertex {
         : position(position), attributes(attributes) {}
 };
 
+// 一个三角形的三个顶点
+using Triangle = FixedVector<Vertex, 3>;
+
 Attributes InterpAttributes(Attributes& attr1, Attributes& attr2,
                             std::function<float(float, float, float)> f,
                             float t);
@@ -177,10 +185,30 @@ void AttributesForeach(Attributes& attr, std::function<float(float)> f) {
     }
 }
 
+// 扫描线每走一个像素调用一次，不经过std::function
+inline void AttributesAccumulate(Attributes& attr, const Attributes& step) {
+    for (int index = 0; index < MAX_ATTRIBUTES_NUM; index++) {
+        attr.varyingFloat[index] += step.varyingFloat[index];
+        attr.varyingVec2[index] += step.varyingVec2[index];
+        attr.varyingVec3[index] += step.varyingVec3[index];
+        attr.varyingVec4[index] += step.varyingVec4[index];
+    }
+}
+
+inline void AttributesScale(Attributes& attr, float scale) {
+    for (int index = 0; index < MAX_ATTRIBUTES_NUM; index++) {
+        attr.varyingFloat[index] *= scale;
+        attr.varyingVec2[index] *= scale;
+        attr.varyingVec3[index] *= scale;
+        attr.varyingVec4[index] *= scale;
+    }
+}
+
 using VertexChanging =
-    std::function<Vertex(Vertex&, Uniforms&, TextureStorage&)>;
-using PixelShading =
-    std::function<Vec4(Attributes&, Uniforms&, TextureStorage&)>;
+    std::function<Vertex(Vertex&, Uniforms&, const TextureStorage&)>;
+// GpuRenderer按行分块在多个线程上同时调用像素着色，uniforms只能读
+using PixelShading = std::function<Vec4(Attributes&, const Uniforms&,
+                                        const TextureStorage&)>;
 
 class Shader {
    public:
@@ -190,21 +218,22 @@ class Shader {
     Uniforms uniforms;
 
     Shader()
-        : vertexChanging([](Vertex& vertex, Uniforms&, TextureStorage&) {
+        : vertexChanging([](Vertex& vertex, Uniforms&, const TextureStorage&) {
               return vertex;
           }),
-          pixelShading([](Attributes&, Uniforms&, TextureStorage&) {
+          pixelShading([](Attributes&, const Uniforms&,
+                          const TextureStorage&) {
               return Vec4::Zero;
           }),
           uniforms(Uniforms()) {}
 
     Vertex CallVertexChanging(Vertex& vertex, Uniforms& uniforms,
-                              TextureStorage& texture_storage) {
+                              const TextureStorage& texture_storage) {
         return vertexChanging(vertex, uniforms, texture_storage);
     }
 
-    Vec4 CallPixelShading(Attributes& attributes, Uniforms& uniforms,
-                          TextureStorage& texture_storage) {
+    Vec4 CallPixelShading(Attributes& attributes, const Uniforms& uniforms,
+                          const TextureStorage& texture_storage) const {
         return pixelShading(attributes, uniforms, texture_storage);
     }
 };
@@ -0,0 +1,172 @@
+#pragma once
+
+// 4路float向量的最小封装，按编译目标选择SSE或NEON，都没有时退回标量
+// 只提供math.hpp需要的几个操作；Load/Store要求16字节对齐，LoadU/StoreU不要求
+// 编译目标支持AVX时另外提供8路的Float8，给批量kernel使用
+
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <immintrin.h>
+#define SIMD_SSE
+#ifdef __AVX__
+#define SIMD_AVX
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+namespace simd {
+
+#if defined(SIMD_SSE)
+
+using Float4 = __m128;
+
+inline Float4 Load(const float *p) { return _mm_load_ps(p); }
+inline void Store(float *p, Float4 v) { _mm_store_ps(p, v); }
+inline Float4 LoadU(const float *p) { return _mm_loadu_ps(p); }
+inline void StoreU(float *p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Splat(float value) { return _mm_set1_ps(value); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+
+// a * b + c；只有编译目标支持FMA时才融合，否则和标量写法的结果一致
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) {
+#ifdef __FMA__
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// 把第I个分量广播到4个通道
+template <int I>
+inline Float4 Lane(Float4 v) {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I));
+}
+
+#elif defined(SIMD_NEON)
+
+using Float4 = float32x4_t;
+
+inline Float4 Load(const float *p) { return vld1q_f32(p); }
+inline void Store(float *p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 LoadU(const float *p) { return vld1q_f32(p); }
+inline void StoreU(float *p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Splat(float value) { return vdupq_n_f32(value); }
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) {
+    return vfmaq_f32(c, a, b);
+}
+
+template <int I>
+inline Float4 Lane(Float4 v) {
+    return vdupq_laneq_f32(v, I);
+}
+
+#else
+
+struct Float4 {
+    float v[4];
+};
+
+inline Float4 Load(const float *p) { return Float4{{p[0], p[1], p[2], p[3]}}; }
+
+inline void Store(float *p, Float4 v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = v.v[i];
+    }
+}
+
+inline Float4 LoadU(const float *p) { return Load(p); }
+inline void StoreU(float *p, Float4 v) { Store(p, v); }
+
+inline Float4 Splat(float value) {
+    return Float4{{value, value, value, value}};
+}
+
+#define SIMD_SCALAR_OP(name, op)                                        \
+    inline Float4 name(Float4 a, Float4 b) {                            \
+        return Float4{{a.v[0] op b.v[0], a.v[1] op b.v[1],              \
+                       a.v[2] op b.v[2], a.v[3] op b.v[3]}};            \
+    }
+SIMD_SCALAR_OP(Add, +)
+SIMD_SCALAR_OP(Sub, -)
+SIMD_SCALAR_OP(Mul, *)
+SIMD_SCALAR_OP(Div, /)
+#undef SIMD_SCALAR_OP
+
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) {
+    return Add(Mul(a, b), c);
+}
+
+template <int I>
+inline Float4 Lane(Float4 v) {
+    return Splat(v.v[I]);
+}
+
+#endif
+
+#ifdef SIMD_AVX
+
+using Float8 = __m256;
+
+inline Float8 Add(Float8 a, Float8 b) { return _mm256_add_ps(a, b); }
+inline Float8 Sub(Float8 a, Float8 b) { return _mm256_sub_ps(a, b); }
+inline Float8 Mul(Float8 a, Float8 b) { return _mm256_mul_ps(a, b); }
+inline Float8 Div(Float8 a, Float8 b) { return _mm256_div_ps(a, b); }
+
+inline Float8 MulAdd(Float8 a, Float8 b, Float8 c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+#endif
+
+// 标量版本，批量kernel用来处理凑不满一组的尾部
+inline float Add(float a, float b) { return a + b; }
+inline float Sub(float a, float b) { return a - b; }
+inline float Mul(float a, float b) { return a * b; }
+inline float Div(float a, float b) { return a / b; }
+inline float MulAdd(float a, float b, float c) { return a * b + c; }
+
+// 批量kernel的通道宽度：按宽度写一次kernel模板，依次用最宽的可用宽度处理
+// 数据，剩下的交给更窄的宽度
+struct Wide1 {
+    using Type = float;
+    static constexpr size_t WIDTH = 1;
+    static Type Load(const float *p) { return *p; }
+    static void Store(float *p, Type v) { *p = v; }
+    static Type Splat(float value) { return value; }
+};
+
+struct Wide4 {
+    using Type = Float4;
+    static constexpr size_t WIDTH = 4;
+    static Type Load(const float *p) { return LoadU(p); }
+    static void Store(float *p, Type v) { StoreU(p, v); }
+    static Type Splat(float value) { return simd::Splat(value); }
+};
+
+#ifdef SIMD_AVX
+struct Wide8 {
+    using Type = Float8;
+    static constexpr size_t WIDTH = 8;
+    static Type Load(const float *p) { return _mm256_loadu_ps(p); }
+    static void Store(float *p, Type v) { _mm256_storeu_ps(p, v); }
+    static Type Splat(float value) { return _mm256_set1_ps(value); }
+};
+#endif
+
+}  // namespace simd
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "SDL.h"
 #include "SDL_image.h"
+#include "job_system.hpp"
 #include "math.hpp"
+#include "trace.hpp"
 
 class Texture {
    private:
@@ -17,12 +22,31 @@ class Texture {
                           x * surface_->format->BytesPerPixel);
     }
 
+    // 采样时用到的尺寸信息，加载时算好，避免每次采样再去查surface
+    int width_ = 0;
+    int height_ = 0;
+    int pitch_ = 0;
+    const Uint8 *pixels_ = nullptr;
+    bool isPow2_ = false;
+    uint32_t widthMask_ = 0;
+    uint32_t heightMask_ = 0;
+
     void load(const char *filename) {
+        TRACE_ZONE("texture decode");
         surface_ = SDL_ConvertSurfaceFormat(IMG_Load(filename),
                                             SDL_PIXELFORMAT_RGBA32, 0);
         if (!surface_) {
             SDL_Log("load %s failed", filename);
+            return;
         }
+        width_ = surface_->w;
+        height_ = surface_->h;
+        pitch_ = surface_->pitch;
+        pixels_ = (const Uint8 *)surface_->pixels;
+        isPow2_ =
+            (width_ & (width_ - 1)) == 0 && (height_ & (height_ - 1)) == 0;
+        widthMask_ = width_ - 1;
+        heightMask_ = height_ - 1;
     }
 
    public:
@@ -34,9 +58,23 @@ class Texture {
         load(filename);
     }
 
-    uint32_t Width() { return surface_->w; }
+    uint32_t Width() const { return width_; }
+
+    uint32_t Height() const { return height_; }
 
-    uint32_t Height() { return surface_->h; }
+    // 宽高都是2的幂时，寻址可以直接用位与
+    bool IsPow2() const { return isPow2_; }
+    uint32_t WidthMask() const { return widthMask_; }
+    uint32_t HeightMask() const { return heightMask_; }
+
+    // 不做边界检查，x和y必须已经在纹理范围内
+    // surface是RGBA32格式，内存中的字节顺序就是r,g,b,a
+    Color4 Fetch(int x, int y) const {
+        const Uint8 *texel = pixels_ + (height_ - y - 1) * pitch_ + x * 4;
+        constexpr float inv = 1.0f / 255.0f;
+        return Color4{texel[0] * inv, texel[1] * inv, texel[2] * inv,
+                      texel[3] * inv};
+    }
 
     Color4 GetPixel(int x, int y) const {
         const Uint32 *color = getPixel(x, surface_->h - y - 1);
@@ -46,9 +84,12 @@ class Texture {
     }
 };
 
+// 不对应任何贴图的id，用来表示"不绑定贴图"
+const uint32_t NO_TEXTURE = UINT32_MAX;
+
 class TextureStorage {
    private:
-    uint32_t cur_id_;
+    uint32_t cur_id_ = 0;
     std::map<uint32_t, Texture> images_;
     std::map<std::string, uint32_t> name_id_map_;
 
@@ -60,7 +101,27 @@ class TextureStorage {
         name_id_map_.insert(std::make_pair<>(name, id));
     }
 
-    std::optional<Texture> GetById(uint32_t id) {
+    // 贴图之间互不依赖，在任务线程上并行解码；id按顺序分配，和逐个load相同
+    void LoadAll(const std::vector<std::string> &filenames,
+                 const std::vector<std::string> &names) {
+        std::vector<std::optional<Texture>> textures(names.size());
+        auto firstId = cur_id_;
+        JobSystem::Global().ParallelFor(
+            0, names.size(), 1, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    textures[i].emplace(filenames[i].c_str(), firstId + i,
+                                        names[i]);
+                }
+            });
+        for (size_t i = 0; i < names.size(); i++) {
+            auto id = cur_id_;
+            cur_id_++;
+            images_.insert(std::make_pair<>(id, std::move(*textures[i])));
+            name_id_map_.insert(std::make_pair<>(names[i], id));
+        }
+    }
+
+    std::optional<Texture> GetById(uint32_t id) const {
         if (images_.find(id) == images_.end()) {
             return std::nullopt;
         } else {
@@ -68,7 +129,13 @@ class TextureStorage {
         }
     }
 
-    std::optional<Texture> GetByName(std::string name) {
+    // 不复制Texture，着色器里逐像素查找时使用；没有这个id时返回nullptr
+    const Texture *FindById(uint32_t id) const {
+        auto it = images_.find(id);
+        return it == images_.end() ? nullptr : &it->second;
+    }
+
+    std::optional<Texture> GetByName(std::string name) const {
         if (name_id_map_.find(name) == name_id_map_.end()) {
             return std::nullopt;
         } else {
@@ -76,7 +143,7 @@ class TextureStorage {
         }
     }
 
-    std::optional<uint32_t> GetId(std::string name) {
+    std::optional<uint32_t> GetId(std::string name) const {
         if (name_id_map_.find(name) == name_id_map_.end()) {
             return std::nullopt;
         } else {
@@ -0,0 +1,216 @@
+#pragma once
+
+// 热路径的分段计时，导出为Chrome trace_event格式的JSON，可以用Perfetto或
+// chrome://tracing打开，看每个线程在各个阶段花的时间
+// 定义SOFTRENDER_TRACE时TRACE_ZONE才会记录，否则展开为空，不影响性能；
+// Start/Stop/WriteChromeJson始终可以调用，没有编译进来时导出的是空文件
+//
+// 每个线程第一次记录时分配自己的环形缓冲区，之后只有这个线程写入，
+// 写入不加锁；缓冲区满了覆盖最早的事件。时间戳在x86上直接读TSC，
+// 导出时用steady_clock换算成微秒
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TRACE_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_HAS_TSC
+#endif
+
+namespace trace {
+
+// 每个线程缓冲的事件数
+constexpr size_t THREAD_BUFFER_EVENTS = 1 << 16;
+
+inline uint64_t Now() {
+#ifdef TRACE_HAS_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+struct Event {
+    // 必须是字符串字面量之类生命周期足够长的字符串
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct ThreadBuffer {
+    uint32_t id;
+    std::string name;
+    std::unique_ptr<Event[]> events;
+    // 写入过的事件总数，只有所属线程修改
+    std::atomic<uint64_t> count{0};
+};
+
+class Recorder {
+   public:
+    static Recorder &Instance() {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    bool Active() const { return active_.load(std::memory_order_relaxed); }
+
+    // 之前记录的事件不清除，导出时按开始时间过滤掉
+    void Start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        startTicks_ = Now();
+        startClock_ = std::chrono::steady_clock::now();
+        active_.store(true, std::memory_order_release);
+    }
+
+    void Stop() { active_.store(false, std::memory_order_release); }
+
+    void Record(const char *name, uint64_t begin, uint64_t end) {
+        auto &buffer = threadBuffer();
+        auto index = buffer.count.load(std::memory_order_relaxed);
+        buffer.events[index % THREAD_BUFFER_EVENTS] = Event{name, begin, end};
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    // 给当前线程起名，显示在trace的线程列表里
+    void SetThreadName(std::string name) {
+        auto &buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer.name = std::move(name);
+    }
+
+    // 应该在Stop之后、没有线程还在记录时调用
+    bool WriteChromeJson(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        // 用这段时间内TSC和steady_clock各自走过的量换算
+        std::chrono::duration<double, std::micro> elapse =
+            std::chrono::steady_clock::now() - startClock_;
+        auto ticks = Now() - startTicks_;
+        double usPerTick = ticks > 0 ? elapse.count() / ticks : 0.0;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        for (auto &buffer : buffers_) {
+            fprintf(file,
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->id, buffer->name.c_str());
+            first = false;
+            auto count = buffer->count.load(std::memory_order_acquire);
+            auto begin = count > THREAD_BUFFER_EVENTS
+                             ? count - THREAD_BUFFER_EVENTS
+                             : 0;
+            for (auto i = begin; i < count; i++) {
+                auto &event = buffer->events[i % THREAD_BUFFER_EVENTS];
+                if (event.begin < startTicks_) {
+                    continue;
+                }
+                fprintf(file,
+                        ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                        "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                        event.name, buffer->id,
+                        (event.begin - startTicks_) * usPerTick,
+                        (event.end - event.begin) * usPerTick);
+            }
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+   private:
+    std::atomic<bool> active_{false};
+    std::mutex mutex_;
+    // 线程退出后缓冲区仍然保留，导出时还能看到它记录的事件
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    uint64_t startTicks_ = 0;
+    std::chrono::steady_clock::time_point startClock_;
+
+    ThreadBuffer &threadBuffer() {
+        static thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer) {
+            auto created = std::make_unique<ThreadBuffer>();
+            created->events = std::make_unique<Event[]>(THREAD_BUFFER_EVENTS);
+            std::lock_guard<std::mutex> lock(mutex_);
+            created->id = buffers_.size();
+            created->name = "thread " + std::to_string(created->id);
+            buffer = created.get();
+            buffers_.push_back(std::move(created));
+        }
+        return *buffer;
+    }
+};
+
+// 作用域内的一段计时，析构时记录；开始时没在记录就什么也不做
+class Zone {
+   public:
+    explicit Zone(const char *name)
+        : name_(Recorder::Instance().Active() ? name : nullptr),
+          begin_(name_ ? Now() : 0) {}
+
+    ~Zone() {
+        if (name_) {
+            Recorder::Instance().Record(name_, begin_, Now());
+        }
+    }
+
+    Zone(const Zone &) = delete;
+    Zone &operator=(const Zone &) = delete;
+
+   private:
+    const char *name_;
+    uint64_t begin_;
+};
+
+inline void Start() { Recorder::Instance().Start(); }
+inline void Stop() { Recorder::Instance().Stop(); }
+
+#ifdef SOFTRENDER_TRACE
+inline void SetThreadName(std::string name) {
+    Recorder::Instance().SetThreadName(std::move(name));
+}
+#else
+// 不记录时线程名没有用处
+inline void SetThreadName(std::string) {}
+#endif
+
+inline bool WriteChromeJson(const std::string &path) {
+    return Recorder::Instance().WriteChromeJson(path);
+}
+
+// 编译时是否打开了记录
+constexpr bool Enabled() {
+#ifdef SOFTRENDER_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef SOFTRENDER_TRACE
+#define TRACE_ZONE(name) \
+    ::trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+#define TRACE_ZONE(name) \
+    do {                 \
+    } while (0)
+#endif
@@ -0,0 +1,127 @@
+// 检查稳定状态下渲染一帧是否还有堆分配
+// 转台动画画两圈：第一圈让各种缓冲长到需要的大小，第二圈逐帧统计分配次数；
+// 填充和线框两种模式各检查一遍，有分配时返回1
+// 用法: softrender_alloc_check [--frames N] [--model K]
+//                              [--renderer gpu|cpu|auto] [--threads T]
+//                              [--cache-dir 目录]
+// 计数靠替换全局的operator new，所以单独编译成一个程序，主程序用标准的分配器
+// 需要在resources目录所在的目录下运行
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "job_system.hpp"
+#include "renderer_factory.hpp"
+#include "scene.hpp"
+
+// 统计operator new的调用次数
+std::atomic<size_t> g_heapAllocations{0};
+
+void* operator new(size_t size) {
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// 不让delete内联，否则GCC看到operator new返回的指针交给free会误报
+// -Wmismatched-new-delete
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+const uint32_t WIDTH = 1024;
+const uint32_t HEIGHT = 720;
+
+struct AllocationCheckConfig {
+    // 每圈的帧数
+    uint32_t frames = 36;
+    uint32_t model = 0;
+    RendererBackend backend = RendererBackend::Gpu;
+    // 网格缓存的目录，空时放在resources下的OBJ文件旁边
+    std::string cacheDir;
+};
+
+int RunAllocationCheck(const AllocationCheckConfig& config) {
+    SceneLoadOptions loadOptions;
+    loadOptions.cacheDir = config.cacheDir;
+    auto scene = Scene::Load(MODEL_FILES[config.model % MODEL_FILES.size()],
+                             loadOptions);
+    if (!scene) {
+        return 1;
+    }
+    int ret = 0;
+    auto camera = CreateDefaultCamera(WIDTH, HEIGHT);
+    auto renderer = CreateRenderer(WIDTH, HEIGHT, camera, config.backend);
+    SetupRenderer(*renderer);
+    CommandBuffer commands(UNIFORM_TEXTURE);
+    auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+    auto frames = config.frames;
+    for (auto mode : {"fill", "framework"}) {
+        size_t total = 0;
+        size_t worst = 0;
+        for (uint32_t i = 0; i < frames * 2; i++) {
+            auto model = CreateTurntableModel(360.0f * i / frames);
+            auto before = g_heapAllocations.load();
+            renderer->Clear(clearColor);
+            renderer->ClearDepth();
+            scene->Draw(*renderer, model, commands);
+            renderer->GetRenderedImage();
+            auto count = g_heapAllocations.load() - before;
+            if (i >= frames) {
+                total += count;
+                worst = std::max(worst, count);
+            }
+        }
+        printf("allocation check (%s, %s): %zu allocations in %u frames, "
+               "at most %zu per frame\n",
+               RendererBackendName(config.backend), mode, total, frames,
+               worst);
+        if (total > 0) {
+            ret = 1;
+        }
+        renderer->ToggleFramework();
+    }
+    return ret;
+}
+
+int main(int argv, char** args) {
+    AllocationCheckConfig config;
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--frames" && hasValue) {
+            config.frames = std::max(1ul, std::stoul(args[++i]));
+        } else if (arg == "--model" && hasValue) {
+            config.model = std::stoul(args[++i]);
+        } else if (arg == "--renderer" && hasValue) {
+            auto parsed = ParseRendererBackend(args[++i]);
+            if (!parsed) {
+                fprintf(stderr, "unknown renderer: %s\n", args[i]);
+                return 1;
+            }
+            config.backend = parsed.value();
+        } else if (arg == "--threads" && hasValue) {
+            JobSystem::SetGlobalWorkerCount(std::stoul(args[++i]));
+        } else if (arg == "--cache-dir" && hasValue) {
+            config.cacheDir = args[++i];
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    SDL_Init(0);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    int ret = RunAllocationCheck(config);
+    IMG_Quit();
+    SDL_Quit();
+    return ret;
+}
@@ -0,0 +1,622 @@
+// 微基准：测量数学运算、光栅化各步骤、整帧渲染、模型解析和任务系统的吞吐量
+// 用法: softrender_bench [--filter 子串] [--min-time 秒] [--json 输出文件]
+//                        [--baseline 基准文件] [--threshold 比例]
+// 用到模型和贴图的项需要在resources目录所在的目录下运行
+// 给了--baseline时和之前--json输出的结果对比，有项变慢超过threshold时返回1
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.hpp"
+#include "image.hpp"
+#include "job_system.hpp"
+#include "math.hpp"
+#include "obj_loader.hpp"
+#include "renderer_factory.hpp"
+#include "scanline.hpp"
+#include "scene.hpp"
+
+struct BenchCase {
+    std::string name;
+    // 每次调用body处理的元素数
+    size_t items;
+    std::function<void()> body;
+};
+
+struct BenchConfig {
+    std::string filter;
+    double minSeconds = 0.3;
+    std::string jsonPath;
+    std::string baselinePath;
+    // 比基准慢超过这个比例算退化
+    double threshold = 0.1;
+};
+
+struct BenchResult {
+    std::string name;
+    double nsPerItem;
+};
+
+// 防止结果被优化掉
+real g_checksum = 0.0f;
+
+// 反复运行直到超过minSeconds，返回每个元素的纳秒数
+double RunBench(const BenchCase& bench, const BenchConfig& config) {
+    using Clock = std::chrono::high_resolution_clock;
+    bench.body();
+    size_t iterations = 1;
+    while (true) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            bench.body();
+        }
+        std::chrono::duration<double> elapse = Clock::now() - start;
+        if (elapse.count() >= config.minSeconds) {
+            return elapse.count() * 1e9 / (iterations * bench.items);
+        }
+        iterations *= 2;
+    }
+}
+
+Mat44 RandomMatrix(std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Mat44 m;
+    for (size_t x = 0; x < 4; x++) {
+        for (size_t y = 0; y < 4; y++) {
+            m.Set(x, y, dist(rng));
+        }
+    }
+    return m;
+}
+
+std::vector<BenchCase> CreateTransformBenches() {
+    const size_t COUNT = 4096;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto vectors = std::make_shared<std::vector<Vec4>>(COUNT);
+    auto output = std::make_shared<std::vector<Vec4>>(COUNT);
+    auto matrices = std::make_shared<std::vector<Mat44>>();
+    for (auto& v : *vectors) {
+        v = Vec4{dist(rng), dist(rng), dist(rng), 1.0f};
+    }
+    for (size_t i = 0; i < COUNT; i++) {
+        matrices->push_back(RandomMatrix(rng));
+    }
+    auto mvp = RandomMatrix(rng);
+
+    std::vector<BenchCase> benches;
+    benches.push_back({"mat44_mul_vec4", COUNT, [=]() {
+                           for (size_t i = 0; i < COUNT; i++) {
+                               (*output)[i] = mvp * (*vectors)[i];
+                           }
+                           g_checksum += (*output)[COUNT - 1].x;
+                       }});
+    // 通用模板的标量实现，用来对比
+    benches.push_back({"mat44_mul_vec4_scalar", COUNT, [=]() {
+                           for (size_t i = 0; i < COUNT; i++) {
+                               (*output)[i] =
+                                   operator*<4, 4, 4>(mvp, (*vectors)[i]);
+                           }
+                           g_checksum += (*output)[COUNT - 1].x;
+                       }});
+    benches.push_back({"mat44_mul_mat44", COUNT, [=]() {
+                           Mat44 m = Mat44::Eye();
+                           for (size_t i = 0; i < COUNT; i++) {
+                               m = (*matrices)[i] * mvp;
+                           }
+                           g_checksum += m.Get(0, 0);
+                       }});
+    benches.push_back({"mat44_mul_mat44_scalar", COUNT, [=]() {
+                           Mat44 m = Mat44::Eye();
+                           for (size_t i = 0; i < COUNT; i++) {
+                               m = operator*<4, 4, 4, 4>((*matrices)[i], mvp);
+                           }
+                           g_checksum += m.Get(0, 0);
+                       }});
+    benches.push_back({"vec4_lerp", COUNT, [=]() {
+                           for (size_t i = 0; i + 1 < COUNT; i++) {
+                               (*output)[i] = Lerp((*vectors)[i],
+                                                   (*vectors)[i + 1], 0.25f);
+                           }
+                           g_checksum += (*output)[0].x;
+                       }});
+    return benches;
+}
+
+// 整个mesh一起变换的批量kernel
+std::vector<BenchCase> CreateBatchBenches() {
+    const size_t COUNT = 4096;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto points = std::make_shared<std::vector<Vec4>>(COUNT);
+    auto output = std::make_shared<std::vector<Vec4>>(COUNT);
+    auto input = std::make_shared<Vec4Stream>();
+    auto result = std::make_shared<Vec4Stream>();
+    auto normals = std::make_shared<std::vector<Vec3>>(COUNT);
+    auto normalOutput = std::make_shared<std::vector<Vec3>>(COUNT);
+    input->Resize(COUNT);
+    result->Resize(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        (*points)[i] = Vec4{dist(rng), dist(rng), dist(rng), 1.0f};
+        // 保证投影后的w不为0
+        (*points)[i].z -= 3.0f;
+        input->Set(i, (*points)[i]);
+        (*normals)[i] = Vec3{dist(rng), dist(rng), dist(rng)};
+    }
+    auto modelView = RandomMatrix(rng);
+    auto frustum = Frustum{1.0f, 1000.0f, 1024.0f / 720.0f, Radians(60.0f)};
+    auto mapping = ScreenMapping::FromViewport(0, 0, 1024, 720, 1.0f);
+
+    std::vector<BenchCase> benches;
+    benches.push_back({"transform_points_aos", COUNT, [=]() {
+                           TransformPoints(modelView, *points, *output);
+                           g_checksum += (*output)[COUNT - 1].x;
+                       }});
+    benches.push_back({"transform_points_soa", COUNT, [=]() {
+                           TransformPoints(modelView, input->View(),
+                                           result->View(), COUNT);
+                           g_checksum += result->Get(COUNT - 1).x;
+                       }});
+    benches.push_back({"project_to_screen_soa", COUNT, [=]() {
+                           ProjectToScreen(frustum.mat, mapping, input->View(),
+                                           result->View(), COUNT);
+                           g_checksum += result->Get(COUNT - 1).x;
+                       }});
+    benches.push_back({"transform_normals", COUNT, [=]() {
+                           TransformNormals(modelView, *normals,
+                                            *normalOutput);
+                           g_checksum += (*normalOutput)[COUNT - 1].x;
+                       }});
+    return benches;
+}
+
+// 每个元素一段纯计算，用来看任务系统随线程数的扩展
+real BusyWork(size_t i) {
+    real x = i * 0.001f;
+    for (int k = 0; k < 256; k++) {
+        x = x * 0.999f + 0.5f;
+    }
+    return x;
+}
+
+std::vector<BenchCase> CreateJobBenches() {
+    const size_t COUNT = 1 << 14;
+    std::vector<BenchCase> benches;
+
+    // 同样的工作量在不同线程数下的吞吐量
+    auto hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t workers = 1; workers <= hardware; workers *= 2) {
+        auto system = std::make_shared<JobSystem>(workers);
+        auto output = std::make_shared<std::vector<real>>(COUNT);
+        benches.push_back(
+            {"jobs_parallel_for_w" + std::to_string(workers), COUNT, [=]() {
+                 system->ParallelFor(0, COUNT, 64,
+                                     [&](size_t first, size_t last) {
+                                         for (size_t i = first; i < last;
+                                              i++) {
+                                             (*output)[i] = BusyWork(i);
+                                         }
+                                     });
+                 g_checksum += (*output)[COUNT - 1];
+             }});
+    }
+    auto output = std::make_shared<std::vector<real>>(COUNT);
+    benches.push_back({"jobs_serial_baseline", COUNT, [=]() {
+                           for (size_t i = 0; i < COUNT; i++) {
+                               (*output)[i] = BusyWork(i);
+                           }
+                           g_checksum += (*output)[COUNT - 1];
+                       }});
+    return benches;
+}
+
+// 光栅化的各个步骤，输入是随机生成的屏幕空间三角形
+Vertex RandomVertex(std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    auto attributes = Attributes();
+    for (size_t i = 0; i < MAX_ATTRIBUTES_NUM; i++) {
+        attributes.varyingFloat[i] = dist(rng);
+        attributes.varyingVec2[i] = Vec2{dist(rng), dist(rng)};
+        attributes.varyingVec3[i] = Vec3{dist(rng), dist(rng), dist(rng)};
+        attributes.varyingVec4[i] =
+            Vec4{dist(rng), dist(rng), dist(rng), dist(rng)};
+    }
+    // 屏幕上的位置，z是到相机的距离
+    auto position = Vec4{dist(rng) * 1024.0f, dist(rng) * 720.0f,
+                         1.0f + dist(rng) * 10.0f, 1.0f};
+    return Vertex{position, attributes};
+}
+
+std::vector<BenchCase> CreateRasterBenches() {
+    const size_t COUNT = 1024;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    auto vertices = std::make_shared<std::vector<Vertex>>();
+    for (size_t i = 0; i < COUNT * 3; i++) {
+        vertices->push_back(RandomVertex(rng));
+    }
+    auto points = std::make_shared<std::vector<Vec2>>();
+    for (size_t i = 0; i < COUNT; i++) {
+        points->push_back(Vec2{dist(rng) * 1024.0f, dist(rng) * 720.0f});
+    }
+
+    std::vector<BenchCase> benches;
+    // 每个像素一次，和GpuRenderer中遍历包围盒时一样
+    benches.push_back(
+        {"barycentric", COUNT, [=]() {
+             auto& v = *vertices;
+             std::array<Vec2, 3> triangle = {
+                 Vec2{v[0].position.x, v[0].position.y},
+                 Vec2{v[1].position.x, v[1].position.y},
+                 Vec2{v[2].position.x, v[2].position.y}};
+             real sum = 0.0f;
+             for (auto& point : *points) {
+                 auto barycentric = Barycentric(point, triangle);
+                 if (barycentric.IsValid()) {
+                     sum += barycentric.alpha;
+                 }
+             }
+             g_checksum += sum;
+         }});
+    benches.push_back(
+        {"interp_attributes", COUNT, [=]() {
+             auto& v = *vertices;
+             real sum = 0.0f;
+             for (size_t i = 0; i < COUNT; i++) {
+                 auto attributes =
+                     InterpAttributes(v[i].attributes, v[i + 1].attributes,
+                                      Lerp<float>, 0.25f);
+                 sum += attributes.varyingFloat[0];
+             }
+             g_checksum += sum;
+         }});
+    benches.push_back({"trapezoid_from_triangle", COUNT, [=]() {
+                           auto& v = *vertices;
+                           real sum = 0.0f;
+                           for (size_t i = 0; i < COUNT; i++) {
+                               auto [trap1, trap2] = Trapezoid::FromTriangle(
+                                   std::span<const Vertex>(v).subspan(i * 3,
+                                                                      3));
+                               if (trap1.has_value()) {
+                                   sum += trap1->top;
+                               }
+                           }
+                           g_checksum += sum;
+                       }});
+
+    // 三角形上半部分的梯形逐行生成扫描线并走完，步进和
+    // RasterizeTrapezoid相同，不含深度测试和着色；按走过的像素计数
+    auto trapezoid = std::make_shared<std::optional<Trapezoid>>();
+    auto triangle = std::array<Vertex, 3>{(*vertices)[0], (*vertices)[1],
+                                          (*vertices)[2]};
+    triangle[0].position = Vec4{100.0f, 100.0f, 2.0f, 1.0f};
+    triangle[1].position = Vec4{50.0f, 200.0f, 3.0f, 1.0f};
+    triangle[2].position = Vec4{400.0f, 300.0f, 4.0f, 1.0f};
+    *trapezoid = std::get<0>(Trapezoid::FromTriangle(triangle));
+    for (auto* v : {&(*trapezoid)->left.v1, &(*trapezoid)->left.v2,
+                    &(*trapezoid)->right.v1, &(*trapezoid)->right.v2}) {
+        VertexRhwInit(*v);
+    }
+    size_t pixels = 0;
+    for (int y = 100; y < 200; y++) {
+        pixels += std::ceil(
+            Scanline::FromTrapezoid(trapezoid->value(), y).width);
+    }
+    benches.push_back(
+        {"scanline_step", pixels, [=]() {
+             auto& trap = trapezoid->value();
+             real sum = 0.0f;
+             for (int y = 100; y < 200; y++) {
+                 auto scanline = Scanline::FromTrapezoid(trap, y);
+                 auto& vertex = scanline.vertex;
+                 while (scanline.width > 0.0) {
+                     sum += vertex.position.z;
+                     scanline.width -= 1.0;
+                     vertex.position += scanline.step.position;
+                     vertex.attributes = InterpAttributes(
+                         vertex.attributes, scanline.step.attributes,
+                         [](float value1, float value2, float) {
+                             return value1 + value2;
+                         },
+                         0.0);
+                 }
+             }
+             g_checksum += sum;
+         }});
+    return benches;
+}
+
+// 整屏清除，颜色附件分别测立即填充和懒清屏
+std::vector<BenchCase> CreateClearBenches() {
+    const uint32_t W = 1024;
+    const uint32_t H = 720;
+    std::vector<BenchCase> benches;
+    for (bool lazy : {false, true}) {
+        auto color = std::make_shared<ColorAttachment>(W, H);
+        color->SetLazyClear(lazy);
+        benches.push_back({lazy ? "clear_color_lazy" : "clear_color", W * H,
+                           [=]() {
+                               auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+                               color->Clear(clearColor);
+                               g_checksum += color->Get(W - 1, H - 1);
+                           }});
+    }
+    auto depth = std::make_shared<DepthAttachment>(W, H);
+    benches.push_back({"clear_depth", W * H, [=]() {
+                           depth->Clear(
+                               std::numeric_limits<float>::lowest());
+                           g_checksum += depth->Get(W - 1, H - 1);
+                       }});
+    return benches;
+}
+
+std::vector<BenchCase> CreateTextureBenches() {
+    const size_t COUNT = 4096;
+    auto storage = std::make_shared<TextureStorage>();
+    storage->load("./resources/Red/Red.png", "Red.png");
+    auto texture = storage->FindById(0);
+    if (!texture || texture->Width() == 0) {
+        return {};
+    }
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+    auto texcoords = std::make_shared<std::vector<Vec2>>();
+    for (size_t i = 0; i < COUNT; i++) {
+        texcoords->push_back(Vec2{dist(rng), dist(rng)});
+    }
+
+    std::vector<BenchCase> benches;
+    for (auto filter : {TextureFilter::Nearest, TextureFilter::Linear}) {
+        auto sampler =
+            Sampler{filter, AddressMode::Repeat, AddressMode::Repeat};
+        benches.push_back(
+            {filter == TextureFilter::Nearest ? "texture_sample_nearest"
+                                              : "texture_sample_linear",
+             COUNT, [=]() {
+                 real sum = 0.0f;
+                 for (auto& texcoord : *texcoords) {
+                     sum += TextureSample(*texture, sampler, texcoord).x;
+                 }
+                 g_checksum += sum;
+             }});
+    }
+    return benches;
+}
+
+// OBJ单线程解析(包括引用的MTL)，MTL单独再测一次；按文件字节数计
+std::vector<BenchCase> CreateParseBenches() {
+    std::vector<BenchCase> benches;
+    for (auto& fileInfo : MODEL_FILES) {
+        auto objPath = std::filesystem::path{"./resources"} / fileInfo.path /
+                       fileInfo.name;
+        auto mtlPath = objPath;
+        mtlPath.replace_extension(".mtl");
+        auto slug = ModelSlug(fileInfo);
+        if (std::filesystem::exists(objPath)) {
+            benches.push_back(
+                {"obj_parse_" + slug, std::filesystem::file_size(objPath),
+                 [=]() {
+                     auto filename = objPath.string();
+                     auto scene = objloader::LoadFromFile(filename, 1);
+                     g_checksum += scene ? scene->vertices.size() : 0;
+                 }});
+        }
+        if (std::filesystem::exists(mtlPath)) {
+            benches.push_back(
+                {"mtl_parse_" + slug, std::filesystem::file_size(mtlPath),
+                 [=]() {
+                     auto filename = mtlPath;
+                     auto content = objloader::FileContent::fromFile(filename);
+                     auto requester =
+                         objloader::TokenRequester::New(content.value());
+                     auto parser = objloader::MtllibParser(requester.value());
+                     g_checksum += parser.parse().materials.size();
+                 }});
+        }
+    }
+    return benches;
+}
+
+// 每个自带模型在每种光栅化后端上画一整帧(清屏、录制、提交、读回)，
+// 和批量渲染时相同；每次转一度，按帧计
+std::vector<BenchCase> CreateFrameBenches() {
+    const uint32_t W = 1024;
+    const uint32_t H = 720;
+    struct FrameState {
+        std::unique_ptr<IRenderer> renderer;
+        CommandBuffer commands{UNIFORM_TEXTURE};
+        float rotation = 0.0f;
+    };
+    std::vector<BenchCase> benches;
+    for (auto& fileInfo : MODEL_FILES) {
+        std::shared_ptr<const Scene> scene = Scene::Load(fileInfo);
+        if (!scene) {
+            continue;
+        }
+        for (auto backend : {RendererBackend::Gpu, RendererBackend::Cpu,
+                             RendererBackend::Auto}) {
+            auto state = std::make_shared<FrameState>();
+            auto camera = CreateDefaultCamera(W, H);
+            state->renderer = CreateRenderer(W, H, camera, backend);
+            SetupRenderer(*state->renderer);
+            auto name = std::string("frame_") + RendererBackendName(backend) +
+                        "_" + ModelSlug(fileInfo);
+            benches.push_back({name, 1, [=]() {
+                                   auto& renderer = *state->renderer;
+                                   auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+                                   auto model =
+                                       CreateTurntableModel(state->rotation);
+                                   renderer.Clear(clearColor);
+                                   renderer.ClearDepth();
+                                   scene->Draw(renderer, model,
+                                               state->commands);
+                                   g_checksum +=
+                                       renderer.GetRenderedImage()[0];
+                                   state->rotation += 1.0f;
+                               }});
+        }
+    }
+    return benches;
+}
+
+void WriteJson(const std::string& path, const BenchConfig& config,
+               const std::vector<BenchResult>& results) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        return;
+    }
+    fprintf(file, "{\n  \"min_time\": %g,\n  \"benchmarks\": [\n",
+            config.minSeconds);
+    for (size_t i = 0; i < results.size(); i++) {
+        fprintf(file,
+                "    {\"name\": \"%s\", \"ns_per_item\": %.4f, "
+                "\"items_per_second\": %.1f}%s\n",
+                results[i].name.c_str(), results[i].nsPerItem,
+                results[i].nsPerItem > 0.0 ? 1e9 / results[i].nsPerItem : 0.0,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+// 只读WriteJson写出的格式：按顺序找每一项的name和ns_per_item
+std::optional<std::map<std::string, double>> ReadBaseline(
+    const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    auto text = buffer.str();
+    std::map<std::string, double> baseline;
+    const std::string NAME_KEY = "\"name\": \"";
+    const std::string VALUE_KEY = "\"ns_per_item\": ";
+    size_t pos = 0;
+    while ((pos = text.find(NAME_KEY, pos)) != std::string::npos) {
+        auto nameBegin = pos + NAME_KEY.size();
+        auto nameEnd = text.find('"', nameBegin);
+        auto valuePos = text.find(VALUE_KEY, nameEnd);
+        if (nameEnd == std::string::npos || valuePos == std::string::npos) {
+            return std::nullopt;
+        }
+        baseline[text.substr(nameBegin, nameEnd - nameBegin)] =
+            std::strtod(text.c_str() + valuePos + VALUE_KEY.size(), nullptr);
+        pos = valuePos;
+    }
+    return baseline;
+}
+
+int main(int argv, char** args) {
+    BenchConfig config;
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--filter" && hasValue) {
+            config.filter = args[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            config.minSeconds = std::stod(args[++i]);
+        } else if (arg == "--json" && hasValue) {
+            config.jsonPath = args[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            config.baselinePath = args[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            config.threshold = std::stod(args[++i]);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!config.baselinePath.empty()) {
+        auto loaded = ReadBaseline(config.baselinePath);
+        if (!loaded) {
+            fprintf(stderr, "cannot read baseline %s\n",
+                    config.baselinePath.c_str());
+            return 1;
+        }
+        baseline = std::move(loaded.value());
+    }
+
+    SDL_Init(0);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    auto benches = CreateTransformBenches();
+    auto append = [&](std::vector<BenchCase> group) {
+        for (auto& bench : group) {
+            benches.push_back(std::move(bench));
+        }
+    };
+    append(CreateBatchBenches());
+    append(CreateRasterBenches());
+    append(CreateClearBenches());
+    if (std::filesystem::exists("./resources")) {
+        append(CreateTextureBenches());
+        append(CreateParseBenches());
+        append(CreateFrameBenches());
+    } else {
+        fprintf(stderr,
+                "./resources not found, skip texture, parse and frame "
+                "benchmarks\n");
+    }
+    append(CreateJobBenches());
+
+    printf("%-28s %12s %14s", "benchmark", "ns/item", "Mitems/s");
+    if (!config.baselinePath.empty()) {
+        printf(" %12s %8s", "baseline", "change");
+    }
+    printf("\n");
+    std::vector<BenchResult> results;
+    size_t regressions = 0;
+    for (auto& bench : benches) {
+        if (bench.name.find(config.filter) == std::string::npos) {
+            continue;
+        }
+        auto ns = RunBench(bench, config);
+        results.push_back({bench.name, ns});
+        printf("%-28s %12.3f %14.2f", bench.name.c_str(), ns, 1e3 / ns);
+        if (!config.baselinePath.empty()) {
+            auto it = baseline.find(bench.name);
+            if (it == baseline.end() || it->second <= 0.0) {
+                printf(" %12s %8s", "-", "new");
+            } else {
+                auto change = ns / it->second - 1.0;
+                printf(" %12.3f %+7.1f%%", it->second, change * 100.0);
+                if (change > config.threshold) {
+                    printf("  REGRESSION");
+                    regressions++;
+                }
+            }
+        }
+        printf("\n");
+    }
+    if (!config.jsonPath.empty()) {
+        WriteJson(config.jsonPath, config, results);
+    }
+    // 只是为了让结果被使用
+    if (g_checksum == 12345.0f) {
+        printf("checksum %f\n", g_checksum);
+    }
+    IMG_Quit();
+    SDL_Quit();
+    if (regressions > 0) {
+        printf("%zu benchmarks slower than baseline by more than %.0f%%\n",
+               regressions, config.threshold * 100.0);
+        return 1;
+    }
+    return 0;
+}
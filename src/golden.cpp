@@ -0,0 +1,287 @@
+// 参考图像回归：每种光栅化后端在每个自带模型的几个固定姿态下各画一帧，
+// 和保存的参考图逐像素比较并给出PSNR，同时记录帧时间
+// 用法: softrender_golden [--reference 目录] [--update] [--tolerance 差值]
+//                         [--max-bad-pixels 比例] [--frames N]
+//                         [--output 目录] [--filter 子串]
+//                         [--cache-dir 目录]
+// --update时重新生成参考图(PNG)和帧时间；否则有图像不一致或缺少参考图时返回1
+// 参考图提交在仓库的golden目录下，CTest用它运行这个程序
+// 需要在resources目录所在的目录下运行
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "frame_writer.hpp"
+#include "renderer_factory.hpp"
+#include "scene.hpp"
+
+const uint32_t WIDTH = 1024;
+const uint32_t HEIGHT = 720;
+
+// 转台旋转角度和相机位置；close让模型越过近平面，覆盖裁剪
+struct GoldenPose {
+    const char* name;
+    float rotation;
+    Vec3 cameraPosition;
+};
+
+const std::vector<GoldenPose> GOLDEN_POSES = {
+    {"front", 0.0f, Vec3{0.0, 1.0, 0.0}},
+    {"side", 90.0f, Vec3{0.0, 1.0, 0.0}},
+    {"back", 210.0f, Vec3{0.0, 1.0, 0.0}},
+    {"close", 30.0f, Vec3{0.3, 0.5, -2.6}},
+};
+
+struct GoldenConfig {
+    std::string referenceDir = "./golden";
+    std::string outputDir;
+    std::string filter;
+    // 网格缓存的目录，空时放在resources下的OBJ文件旁边
+    std::string cacheDir;
+    bool update = false;
+    // 任一通道相差超过tolerance的像素算不一致
+    uint32_t tolerance = 2;
+    // 不一致的像素占比超过这个值时失败
+    double maxBadPixels = 0.0005;
+    // 计时的帧数，取中位数
+    uint32_t frames = 5;
+};
+
+struct ImageDiff {
+    size_t badPixels = 0;
+    uint32_t maxDelta = 0;
+    // 完全相同时为无穷大
+    double psnr = INFINITY;
+};
+
+uint32_t Channel(uint32_t pixel, int shift) { return (pixel >> shift) & 0xFF; }
+
+// 只比较RGB
+ImageDiff CompareImages(std::span<const uint32_t> actual,
+                        std::span<const uint32_t> expected,
+                        uint32_t tolerance) {
+    ImageDiff diff;
+    double squaredError = 0.0;
+    for (size_t i = 0; i < actual.size(); i++) {
+        uint32_t pixelDelta = 0;
+        for (int shift : {16, 8, 0}) {
+            int delta = int(Channel(actual[i], shift)) -
+                        int(Channel(expected[i], shift));
+            squaredError += delta * delta;
+            pixelDelta = std::max<uint32_t>(pixelDelta, std::abs(delta));
+        }
+        diff.maxDelta = std::max(diff.maxDelta, pixelDelta);
+        if (pixelDelta > tolerance) {
+            diff.badPixels++;
+        }
+    }
+    double mse = squaredError / (actual.size() * 3.0);
+    if (mse > 0.0) {
+        diff.psnr = 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+    return diff;
+}
+
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0.0 : values[values.size() / 2];
+}
+
+// 参考帧时间：每行"名字,毫秒"
+std::map<std::string, double> ReadFrameTimes(const std::string& path) {
+    std::map<std::string, double> times;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        auto comma = line.find(',');
+        if (comma != std::string::npos) {
+            times[line.substr(0, comma)] = std::atof(line.c_str() + comma + 1);
+        }
+    }
+    return times;
+}
+
+int main(int argv, char** args) {
+    GoldenConfig config;
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--reference" && hasValue) {
+            config.referenceDir = args[++i];
+        } else if (arg == "--output" && hasValue) {
+            config.outputDir = args[++i];
+        } else if (arg == "--filter" && hasValue) {
+            config.filter = args[++i];
+        } else if (arg == "--cache-dir" && hasValue) {
+            config.cacheDir = args[++i];
+        } else if (arg == "--update") {
+            config.update = true;
+        } else if (arg == "--tolerance" && hasValue) {
+            config.tolerance = std::stoul(args[++i]);
+        } else if (arg == "--max-bad-pixels" && hasValue) {
+            config.maxBadPixels = std::stod(args[++i]);
+        } else if (arg == "--frames" && hasValue) {
+            config.frames = std::max(1ul, std::stoul(args[++i]));
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    SDL_Init(0);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    std::filesystem::create_directories(config.referenceDir);
+    if (!config.outputDir.empty()) {
+        std::filesystem::create_directories(config.outputDir);
+    }
+    auto timesPath =
+        (std::filesystem::path{config.referenceDir} / "frame_times.csv")
+            .string();
+    auto referenceTimes = ReadFrameTimes(timesPath);
+    std::map<std::string, double> frameTimes;
+
+    printf("%-28s %9s %9s %9s %8s %10s %8s\n", "case", "ms", "ref ms",
+           "change", "PSNR", "bad px", "result");
+    size_t failures = 0;
+    SceneLoadOptions loadOptions;
+    loadOptions.cacheDir = config.cacheDir;
+    for (auto& fileInfo : MODEL_FILES) {
+        std::shared_ptr<const Scene> scene;
+        for (auto backend : {RendererBackend::Gpu, RendererBackend::Cpu,
+                             RendererBackend::Auto}) {
+            for (auto& pose : GOLDEN_POSES) {
+                auto name = std::string(RendererBackendName(backend)) + "_" +
+                            ModelSlug(fileInfo) + "_" + pose.name;
+                if (name.find(config.filter) == std::string::npos) {
+                    continue;
+                }
+                if (!scene) {
+                    scene = Scene::Load(fileInfo, loadOptions);
+                    if (!scene) {
+                        printf("%-28s load failed\n", name.c_str());
+                        failures++;
+                        break;
+                    }
+                }
+                auto camera = CreateDefaultCamera(WIDTH, HEIGHT);
+                camera.MoveTo(pose.cameraPosition);
+                auto renderer =
+                    CreateRenderer(WIDTH, HEIGHT, camera, backend);
+                SetupRenderer(*renderer);
+                CommandBuffer commands(UNIFORM_TEXTURE);
+                auto model = CreateTurntableModel(pose.rotation);
+                auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
+
+                // 第一帧让缓冲长到需要的大小，不计时
+                std::vector<double> times;
+                std::span<const uint32_t> pixels;
+                for (uint32_t i = 0; i <= config.frames; i++) {
+                    auto start = std::chrono::steady_clock::now();
+                    renderer->Clear(clearColor);
+                    renderer->ClearDepth();
+                    scene->Draw(*renderer, model, commands);
+                    pixels = renderer->GetRenderedImage();
+                    std::chrono::duration<double, std::milli> elapse =
+                        std::chrono::steady_clock::now() - start;
+                    if (i > 0) {
+                        times.push_back(elapse.count());
+                    }
+                }
+                auto ms = Median(times);
+                frameTimes[name] = ms;
+
+                char change[16] = "-";
+                auto timeIt = referenceTimes.find(name);
+                if (timeIt != referenceTimes.end() && timeIt->second > 0.0) {
+                    snprintf(change, sizeof(change), "%+.1f%%",
+                             (ms / timeIt->second - 1.0) * 100.0);
+                }
+                double referenceMs =
+                    timeIt != referenceTimes.end() ? timeIt->second : 0.0;
+
+                auto referencePath =
+                    (std::filesystem::path{config.referenceDir} /
+                     (name + ".png"))
+                        .string();
+                if (config.update) {
+                    bool ok = WritePNG(referencePath, pixels, WIDTH, HEIGHT);
+                    printf("%-28s %9.2f %9.2f %9s %8s %10s %8s\n",
+                           name.c_str(), ms, referenceMs, change, "-", "-",
+                           ok ? "updated" : "FAILED");
+                    failures += ok ? 0 : 1;
+                    continue;
+                }
+
+                std::vector<uint32_t> expected;
+                uint32_t w = 0;
+                uint32_t h = 0;
+                bool passed = false;
+                char psnr[16] = "-";
+                char bad[16] = "-";
+                if (!ReadPNG(referencePath, expected, w, h)) {
+                    printf("%-28s %9.2f %9.2f %9s %8s %10s %8s\n",
+                           name.c_str(), ms, referenceMs, change, psnr, bad,
+                           "MISSING");
+                } else if (w != WIDTH || h != HEIGHT) {
+                    printf("%-28s %9.2f %9.2f %9s %8s %10s %8s\n",
+                           name.c_str(), ms, referenceMs, change, psnr, bad,
+                           "SIZE");
+                } else {
+                    auto diff =
+                        CompareImages(pixels, expected, config.tolerance);
+                    passed = diff.badPixels <=
+                             config.maxBadPixels * pixels.size();
+                    snprintf(psnr, sizeof(psnr), "%.2f", diff.psnr);
+                    snprintf(bad, sizeof(bad), "%zu", diff.badPixels);
+                    printf("%-28s %9.2f %9.2f %9s %8s %10s %8s\n",
+                           name.c_str(), ms, referenceMs, change, psnr, bad,
+                           passed ? "ok" : "FAILED");
+                }
+                if (!passed) {
+                    failures++;
+                    // 留下实际画面，方便和参考图对比
+                    if (!config.outputDir.empty()) {
+                        WritePNG((std::filesystem::path{config.outputDir} /
+                                  (name + ".png"))
+                                     .string(),
+                                 pixels, WIDTH, HEIGHT);
+                    }
+                }
+            }
+        }
+    }
+
+    if (config.update) {
+        // 只更新这次运行的项，其余保留
+        for (auto& [name, ms] : frameTimes) {
+            referenceTimes[name] = ms;
+        }
+        FILE* file = fopen(timesPath.c_str(), "w");
+        if (file) {
+            for (auto& [name, ms] : referenceTimes) {
+                fprintf(file, "%s,%.3f\n", name.c_str(), ms);
+            }
+            fclose(file);
+        } else {
+            fprintf(stderr, "cannot write %s\n", timesPath.c_str());
+            failures++;
+        }
+    }
+    IMG_Quit();
+    SDL_Quit();
+    if (failures > 0) {
+        printf("%zu cases failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// 任务系统的正确性检查：嵌套等待不会卡住、等待时不会执行别的计数器的任务
+// 用法: softrender_job_check [--timeout 秒]
+// 超时说明有等待卡住了，直接退出并返回1；检查不通过也返回1
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "job_system.hpp"
+
+// 超时后直接结束进程，卡住的工作线程没法正常退出
+class Watchdog {
+   public:
+    explicit Watchdog(std::chrono::seconds timeout)
+        : thread_([this, timeout]() {
+              std::unique_lock<std::mutex> lock(mutex_);
+              if (!cond_.wait_for(lock, timeout, [this]() { return done_; })) {
+                  fprintf(stderr, "timed out after %lld s in %s\n",
+                          (long long)timeout.count(), stage_.c_str());
+                  std::_Exit(1);
+              }
+          }) {}
+
+    ~Watchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void SetStage(const std::string& stage) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stage_ = stage;
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool done_ = false;
+    std::string stage_;
+    std::thread thread_;
+};
+
+// 三层嵌套的ParallelFor，每层都在任务里等待子任务；
+// 线程数比任务少时等待的线程必须自己执行任务，否则会卡住
+bool CheckNestedWait(JobSystem& jobs) {
+    const size_t FANOUT = 16;
+    std::atomic<size_t> leaves{0};
+    auto leaf = [&](size_t first, size_t last) { leaves += last - first; };
+    auto middle = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            jobs.ParallelFor(0, FANOUT, 1, leaf);
+        }
+    };
+    jobs.ParallelFor(0, FANOUT, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            jobs.ParallelFor(0, FANOUT, 1, middle);
+        }
+    });
+    if (leaves != FANOUT * FANOUT * FANOUT) {
+        fprintf(stderr, "nested wait: %zu of %zu jobs ran\n", leaves.load(),
+                FANOUT * FANOUT * FANOUT);
+        return false;
+    }
+    return true;
+}
+
+// 队列里有别的计数器的任务(比如加载)时，当前线程的ParallelFor
+// 只能执行自己的分块，不能把那些任务捡过来
+bool CheckWaitOnlyRunsOwnTasks(JobSystem& jobs) {
+    const size_t BACKGROUND = 64;
+    auto caller = std::this_thread::get_id();
+    std::atomic<size_t> stolen{0};
+    JobCounter background;
+    for (size_t i = 0; i < BACKGROUND; i++) {
+        jobs.Run(
+            [&]() {
+                if (std::this_thread::get_id() == caller) {
+                    stolen++;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            },
+            &background);
+    }
+    for (int frame = 0; frame < 16; frame++) {
+        jobs.ParallelFor(0, 256, 16, [](size_t, size_t) {});
+    }
+    // 最后等background时当前线程执行它的任务是允许的，先记下之前的次数
+    size_t stolenByFrames = stolen;
+    jobs.Wait(background);
+    if (stolenByFrames > 0) {
+        fprintf(stderr, "wait ran %zu unrelated jobs on the caller\n",
+                stolenByFrames);
+        return false;
+    }
+    return true;
+}
+
+int main(int argv, char** args) {
+    std::chrono::seconds timeout{30};
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--timeout" && hasValue) {
+            timeout = std::chrono::seconds(std::stoul(args[++i]));
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    Watchdog watchdog(timeout);
+    size_t failures = 0;
+    for (uint32_t workers : {1u, 2u, 4u}) {
+        JobSystem jobs(workers);
+        struct {
+            const char* name;
+            bool (*check)(JobSystem&);
+        } checks[] = {
+            {"nested_wait", CheckNestedWait},
+            {"wait_only_runs_own_tasks", CheckWaitOnlyRunsOwnTasks},
+        };
+        for (auto& [name, check] : checks) {
+            auto stage = std::string(name) + " with " +
+                         std::to_string(workers) + " workers";
+            watchdog.SetStage(stage);
+            bool ok = check(jobs);
+            printf("%-44s %s\n", stage.c_str(), ok ? "ok" : "FAILED");
+            failures += ok ? 0 : 1;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,212 +1,133 @@
 #include <algorithm>
+#include <csignal>
 #include <iostream>
 #include <memory>
 
 #include "base_renderer.hpp"
-#include "cpu_renderer.hpp"
-#include "gpu_renderer.hpp"
+#include "batch_renderer.hpp"
+#include "frame_writer.hpp"
 #include "image.hpp"
 #include "interactive.hpp"
-#include "model.hpp"
-#include "obj_loader.hpp"
-#include "scanline.hpp"
-#include "shader.hpp"
-#include "texture.hpp"
+#include "output_sink.hpp"
+#include "renderer_factory.hpp"
+#include "scene.hpp"
+#include "scene_loader.hpp"
+#include "trace.hpp"
 
-// #ifndef GPU_FEATURE_ENABLED
-// #define GPU_FEATURE_ENABLED
-// #endif
+#ifndef _WIN32
+#include "render_server.hpp"
+#endif
 
 const uint32_t WINDOW_WIDTH = 1024;
 const uint32_t WINDOW_HEIGHT = 720;
 
-// attribute location
-const size_t ATTR_TEXCOORD = 0;  // vec2
-const size_t ATTR_NORMAL = 0;    // vec3
-
-// uniforms location
-const uint32_t UNIFORM_TEXTURE = 0;  // vec2
-const uint32_t UNIFORM_COLOR = 1;    // vec4
-
-std::unique_ptr<IRenderer> CreateRenderer(uint32_t w, uint32_t h,
-                                          Camera camera) {
-#ifdef CPU_FEATURE_ENABLED
-    return std::make_unique<CpuRenderer>(w, h, camera);
-#else
-    return std::make_unique<GpuRenderer>(w, h, camera);
-#endif
-}
-
-struct ModelFileInfo {
-    std::string path;
-    std::string name;
-};
-
-struct StructedModelData {
-    std::vector<Vertex> vertices;
-    std::optional<uint32_t> mtllib;
-    std::optional<std::string> material;
-};
-
-std::vector<StructedModelData> RestructModelVertex(
-    std::vector<model::Mesh>& meshes) {
-    std::vector<StructedModelData> datas;
-    for (auto& mesh : meshes) {
-        std::vector<Vertex> vertices;
-        for (auto& modelVertex : mesh.vertices) {
-            auto attr = Attributes();
-            attr.varyingVec2[ATTR_TEXCOORD] = modelVertex.texcoord;
-            attr.varyingVec3[ATTR_NORMAL] = modelVertex.normal;
-            vertices.push_back(Vertex{modelVertex.position, attr});
-        }
-        datas.push_back(
-            StructedModelData{vertices, mesh.mtllib, mesh.material});
-    }
-    return datas;
-}
-
 class RedBirdApp : public App {
    private:
     std::unique_ptr<IRenderer> renderer_;
+    // 每帧的绘制命令，跨帧复用
+    CommandBuffer commands_{UNIFORM_TEXTURE};
 
     float rotation_;
-    std::vector<StructedModelData> vertexDatas_;
-    std::vector<objloader::Mtllib> mtllibs_;
-    TextureStorage textureStorage_;
-
-    std::vector<ModelFileInfo> fileInfos_;
-
-    // data prepare, from OBJ model
-    void prepareData(ModelFileInfo& fileInfo) {
-        vertexDatas_ = std::vector<StructedModelData>();
-        mtllibs_ = std::vector<objloader::Mtllib>();
-        textureStorage_ = TextureStorage();
-        std::string MODEL_ROOT_DIR = "./resources/" + fileInfo.path;
-        auto modelResult =
-            model::LoadFromFile(std::filesystem::path{MODEL_ROOT_DIR}
-                                    .append(fileInfo.name)
-                                    .string(),
-                                model::PreOperation::None);
-        if (!modelResult.has_value()) {
-            SDL_Log("load model from %s failed!", MODEL_ROOT_DIR.c_str());
-            return;
-        }
-        auto [meshes, mtllibs] = modelResult.value();
-        mtllibs_ = mtllibs;
-        vertexDatas_ = RestructModelVertex(meshes);
-        for (auto& mtllib : mtllibs) {
-            for (auto [_, material] : mtllib.materials) {
-                if (material.textureMaps.diffuse.has_value()) {
-                    auto diffuseMap = material.textureMaps.diffuse.value();
-                    textureStorage_.load(std::filesystem::path{MODEL_ROOT_DIR}
-                                             .append(diffuseMap)
-                                             .string()
-                                             .c_str(),
-                                         diffuseMap);
-                };
-            }
+    std::shared_ptr<Scene> scene_;
+    SceneLoader loader_;
+    // 启动时的调试热力图，之后按h切换
+    HeatmapMode heatmap_;
+    // 光栅化后端，按r切换
+    RendererBackend backend_;
+
+    // 在后台加载，完成之前继续画当前的模型
+    void prepareData(const ModelFileInfo& fileInfo) {
+        loader_.Request(fileInfo);
+    }
+
+    // 用backend_重新创建渲染器；线框模式回到填充
+    void createRenderer(const Camera& camera, HeatmapMode heatmap) {
+        renderer_ =
+            CreateRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, camera, backend_);
+        SetupRenderer(*renderer_);
+        // renderer_->EnableFramework();
+        renderer_->SetHeatmapMode(heatmap);
+    }
+
+    std::string loadStatusText() const {
+        auto status = loader_.Status();
+        char text[160];
+        if (status.loading) {
+            snprintf(text, sizeof(text), "\n正在加载 %s: %d%%",
+                     status.name.c_str(), int(status.progress * 100));
+        } else {
+            snprintf(text, sizeof(text), "\n%s 加载%s，用时 %.0f ms",
+                     status.name.c_str(),
+                     status.lastLoadFailed ? "失败" : "完成",
+                     status.lastLoadMs);
         }
+        std::string result = text;
+        result += "\n渲染器: ";
+        result += RendererBackendName(backend_);
+        if (renderer_->GetHeatmapMode() != HeatmapMode::Off) {
+            result += "\n热力图: ";
+            result += HeatmapModeName(renderer_->GetHeatmapMode());
+        }
+        return result;
     }
 
    public:
-    RedBirdApp() : App("Soft Renderer APP! ", WINDOW_WIDTH, WINDOW_HEIGHT) {
-        fileInfos_.push_back({"Red", "Red.obj"});
-        fileInfos_.push_back({"Son Goku", "Goku.obj"});
-        fileInfos_.push_back({"cube", "cube.obj"});
-        fileInfos_.push_back({"plane", "plane.obj"});
-    }
+    RedBirdApp(AppConfig config, SceneLoadOptions loadOptions,
+               HeatmapMode heatmap = HeatmapMode::Off,
+               RendererBackend backend = RendererBackend::Gpu)
+        : App("Soft Renderer APP! ", WINDOW_WIDTH, WINDOW_HEIGHT, config),
+          loader_(loadOptions),
+          heatmap_(heatmap),
+          backend_(backend) {}
 
     void OnInit() override {
         rotation_ = 0.0f;
-        auto camera = Camera{1.0, 1000.0, 1.0f * WINDOW_WIDTH / WINDOW_HEIGHT,
-                             Radians(60.0f)};
-        camera.MoveTo(Vec3{0.0, 1.0, 0.0});
-        camera.SetRotation(Vec3{Radians(1.0f), 0.0, 0.0});
-
-        // init renderer and textureStorage
-        renderer_ = CreateRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, camera);
-        renderer_->SetFrontFace(FrontFace::CCW);
-        renderer_->SetFaceCull(FaceCull::Back);
-        // renderer_->EnableFramework();
-        textureStorage_ = TextureStorage();
-
-        prepareData(fileInfos_[0]);
-
-        // vertex changing shader
-        renderer_->GetShader().vertexChanging =
-            [](Vertex& vertex, Uniforms& Uniforms,
-               TextureStorage& textureStorage) { return vertex; };
-        renderer_->GetShader().pixelShading =
-            [](Attributes& attr, Uniforms& uniforms,
-               TextureStorage& textureStorage) {
-                auto fragColor = uniforms.varyingVec4.find(UNIFORM_COLOR) ==
-                                         uniforms.varyingVec4.end()
-                                     ? Vec4{1.0, 1.0, 1.0, 1.0}
-                                     : uniforms.varyingVec4[UNIFORM_COLOR];
-                auto texcoord = attr.varyingVec2[ATTR_TEXCOORD];
-                texcoord.x = std::clamp(texcoord.x, 0.0f, 1.0f);
-                texcoord.y = std::clamp(texcoord.y, 0.0f, 1.0f);
-                if (uniforms.varyingTexuture.find(UNIFORM_TEXTURE) !=
-                    uniforms.varyingTexuture.end()) {
-                    auto& textureId = uniforms.varyingTexuture[UNIFORM_TEXTURE];
-                    auto textureOpt = textureStorage.GetById(textureId);
-                    if (textureOpt.has_value()) {
-                        auto& texture = textureOpt.value();
-                        fragColor *= TextureSample(texture, texcoord);
-                    }
-                };
-                return fragColor;
-            };
+        auto camera = CreateDefaultCamera(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+        // init renderer
+        createRenderer(camera, heatmap_);
+
+        prepareData(MODEL_FILES[0]);
+        // 无窗口模式输出的帧要确定，等第一个模型加载完
+        if (IsHeadless()) {
+            loader_.Wait();
+        }
     }
 
     void OnRender() override {
+        // 在帧之间换上加载完成的场景
+        auto loaded = loader_.TakeLoaded();
+        if (loaded) {
+            scene_ = std::move(loaded);
+        }
+
         auto clearColor = Vec4{0.2, 0.2, 0.2, 1.0};
         renderer_->Clear(clearColor);
         renderer_->ClearDepth();
 
-        auto model = CreateTranslate(Vec3{0.0, 0.0, -4.0}) *
-                     CreateEularRotate_y(Radians(rotation_));
-        for (auto& data : vertexDatas_) {
-            // set data into uniform
-            auto& uniforms = renderer_->GetUniforms();
-            if (data.mtllib.has_value() && data.material.has_value()) {
-                auto& mtllib = mtllibs_[data.mtllib.value()];
-                auto& materialIndex = data.material.value();
-                if (mtllib.materials.find(materialIndex) !=
-                    mtllib.materials.end()) {
-                    auto& material = mtllib.materials[materialIndex];
-                    if (material.ambient.has_value()) {
-                        auto& ambient = material.ambient.value();
-                        uniforms.varyingVec4[UNIFORM_COLOR] =
-                            Vec4::FromVec3(ambient, 1.0f);
-                        // uniforms.varyingVec4.insert(std::make_pair(
-                        //     UNIFORM_COLOR, Vec4::FromVec3(ambient, 1.0f)));
-                    }
-                    if (material.textureMaps.diffuse.has_value()) {
-                        auto& diffuseTexture =
-                            material.textureMaps.diffuse.value();
-                        uniforms.varyingTexuture[UNIFORM_TEXTURE] =
-                            textureStorage_.GetId(diffuseTexture).value();
-                        // uniforms.varyingTexuture.insert(std::make_pair(
-                        //     UNIFORM_TEXTURE,
-                        //     textureStorage_.GetId(diffuseTexture).value()));
-                    }
-                }
-            }
-
-            renderer_->DrawTriangle(model, data.vertices, textureStorage_);
+        auto model = CreateTurntableModel(rotation_);
+        if (scene_) {
+            scene_->Draw(*renderer_, model, commands_);
         }
 
         rotation_ += 1.0f;
-        SwapBuffer(renderer_->GetSurface(),
+        SwapBuffer(renderer_->GetRenderedImage(), renderer_->GetCanvaWidth(),
+                   renderer_->GetCanvaHeight(),
                    "w/a/s/d: (摄像机)前进/左移/后退/右移\n"
                    "q/e: (摄像机)上升/下降\n"
-                   "t: 切换视图模式\n\n"
+                   "t: 切换视图模式\n"
+                   "h: 切换调试热力图\n"
+                   "r: 切换光栅化后端\n\n"
                    "模型切换:\n"
                    "1 -> Red Bird\n"
                    "2 -> Son Goku\n"
                    "3 -> White Cube\n"
-                   "4 -> Reckless Shopkeeper!\n");
+                   "4 -> Reckless Shopkeeper!\n" +
+                       loadStatusText());
+    }
+
+    std::optional<PipelineStats> FrameStats() override {
+        return renderer_->GetStats();
     }
 
     void OnKeyDown(const SDL_KeyboardEvent& e) override {
@@ -232,23 +153,222 @@ class RedBirdApp : public App {
         if (SDLK_t == e.keysym.sym) {
             renderer_->ToggleFramework();
         }
+        if (SDLK_h == e.keysym.sym) {
+            if (!PixelCostBuffer::Enabled()) {
+                SDL_Log("built without SOFTRENDER_DEBUG_VIEW, no heatmap");
+            }
+            renderer_->SetHeatmapMode(
+                NextHeatmapMode(renderer_->GetHeatmapMode()));
+        }
+        if (SDLK_r == e.keysym.sym) {
+            // 相机和热力图沿用当前的
+            backend_ = NextRendererBackend(backend_);
+            createRenderer(renderer_->GetCamera(),
+                           renderer_->GetHeatmapMode());
+            SDL_Log("renderer: %s", RendererBackendName(backend_));
+        }
         if (SDLK_1 == e.keysym.sym) {
-            prepareData(fileInfos_[0]);
+            prepareData(MODEL_FILES[0]);
         }
         if (SDLK_2 == e.keysym.sym) {
-            prepareData(fileInfos_[1]);
+            prepareData(MODEL_FILES[1]);
         }
         if (SDLK_3 == e.keysym.sym) {
-            prepareData(fileInfos_[2]);
+            prepareData(MODEL_FILES[2]);
         }
         if (SDLK_4 == e.keysym.sym) {
-            prepareData(fileInfos_[3]);
+            prepareData(MODEL_FILES[3]);
         }
     }
 };
 
+struct BatchConfig {
+    // 为0时不进入批量模式
+    uint32_t frames = 0;
+    uint32_t model = 0;
+};
+
+// 批量渲染一圈转台动画，模型只加载一次，多个线程按帧并行
+int RunBatch(const BatchConfig& batch, const AppConfig& config,
+             const SceneLoadOptions& loadOptions, RendererBackend backend) {
+    SDL_Init(0);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    int ret = 0;
+    auto scene = Scene::Load(MODEL_FILES[batch.model % MODEL_FILES.size()],
+                             loadOptions);
+    if (!scene) {
+        ret = 1;
+    } else {
+        std::vector<BatchFrame> frames;
+        auto camera = CreateDefaultCamera(WINDOW_WIDTH, WINDOW_HEIGHT);
+        for (uint32_t i = 0; i < batch.frames; i++) {
+            frames.push_back(BatchFrame{
+                camera, CreateTurntableModel(360.0f * i / batch.frames)});
+        }
+        if (!config.outputDir.empty()) {
+            std::filesystem::create_directories(config.outputDir);
+        }
+        std::unique_ptr<AsyncFrameWriter> streamWriter;
+        if (!config.streamFormat.empty()) {
+            auto sink = CreateOutputSink(
+                config.streamFormat, config.streamOutput, config.streamFps);
+            if (sink) {
+                streamWriter = std::make_unique<AsyncFrameWriter>(
+                    std::move(sink),
+                    JobSystem::Global().WorkerCount() * 2 + 2);
+            }
+        }
+        BatchRenderer renderer(scene, WINDOW_WIDTH, WINDOW_HEIGHT, backend);
+        auto stats = renderer.Render(
+            frames, [&](uint32_t index, std::span<const uint32_t> pixels,
+                        uint32_t w, uint32_t h) {
+                if (streamWriter) {
+                    streamWriter->Submit(pixels, w, h);
+                }
+                if (config.outputDir.empty()) {
+                    return;
+                }
+                char name[32];
+                snprintf(name, sizeof(name), "frame_%05u.%s", index,
+                         config.outputFormat.c_str());
+                WriteFrame(
+                    (std::filesystem::path{config.outputDir} / name).string(),
+                    pixels, w, h);
+            });
+        SDL_Log("batch: %u frames on %u threads in %.3f s, %.2f frames/sec",
+                stats.frames, stats.threads, stats.seconds,
+                stats.FramesPerSecond());
+        // 等待视频流写完
+        streamWriter.reset();
+    }
+    IMG_Quit();
+    SDL_Quit();
+    return ret;
+}
+
+#ifndef _WIN32
+RenderServer* g_server = nullptr;
+
+// 常驻的本地渲染服务，Ctrl+C退出
+int RunServer(const std::string& socketPath, uint32_t workers,
+              const SceneLoadOptions& loadOptions) {
+    SDL_Init(0);
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+    RenderServer server(MODEL_FILES, workers, loadOptions);
+    g_server = &server;
+    auto onSignal = [](int) {
+        if (g_server) {
+            g_server->Stop();
+        }
+    };
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    bool ok = server.Run(socketPath);
+    // 先恢复默认处理，之后再来的信号不会访问已经析构的server
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    g_server = nullptr;
+    IMG_Quit();
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
+#endif
+
 int main(int argv, char** args) {
-    RedBirdApp app;
-    app.Run();
-    return 0;
-}
\ No newline at end of file
+    AppConfig config;
+    BatchConfig batch;
+    std::string serverSocket;
+    uint32_t serverWorkers = 0;
+    SceneLoadOptions loadOptions;
+    std::string tracePath;
+    auto heatmap = HeatmapMode::Off;
+    auto backend = RendererBackend::Gpu;
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--present-thread") {
+            config.presentThread = true;
+        } else if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            config.headlessFrames = std::stoul(args[++i]);
+        } else if (arg == "--output" && hasValue) {
+            config.outputDir = args[++i];
+        } else if (arg == "--format" && hasValue) {
+            config.outputFormat = args[++i];
+        } else if (arg == "--stream" && hasValue) {
+            config.streamFormat = args[++i];
+        } else if (arg == "--stream-output" && hasValue) {
+            config.streamOutput = args[++i];
+        } else if (arg == "--stream-fps" && hasValue) {
+            config.streamFps = std::stoul(args[++i]);
+        } else if (arg == "--stream-drop") {
+            config.streamDropFrames = true;
+        } else if (arg == "--stats") {
+            config.showStats = true;
+        } else if (arg == "--stats-csv" && hasValue) {
+            config.statsCsv = args[++i];
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = args[++i];
+        } else if (arg == "--heatmap" && hasValue) {
+            auto mode = ParseHeatmapMode(args[++i]);
+            if (!mode) {
+                SDL_Log("unknown heatmap mode: %s", args[i]);
+            } else if (!PixelCostBuffer::Enabled()) {
+                SDL_Log("built without SOFTRENDER_DEBUG_VIEW, no heatmap");
+            } else {
+                heatmap = mode.value();
+            }
+        } else if (arg == "--renderer" && hasValue) {
+            auto parsed = ParseRendererBackend(args[++i]);
+            if (parsed) {
+                backend = parsed.value();
+            } else {
+                SDL_Log("unknown renderer: %s", args[i]);
+            }
+        } else if (arg == "--server" && hasValue) {
+            serverSocket = args[++i];
+        } else if (arg == "--server-workers" && hasValue) {
+            serverWorkers = std::stoul(args[++i]);
+        } else if (arg == "--load-memory-limit" && hasValue) {
+            loadOptions.memoryLimit = std::stoull(args[++i]) << 20;
+        } else if (arg == "--batch" && hasValue) {
+            batch.frames = std::stoul(args[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            JobSystem::SetGlobalWorkerCount(std::stoul(args[++i]));
+        } else if (arg == "--model" && hasValue) {
+            batch.model = std::stoul(args[++i]);
+        } else {
+            SDL_Log("unknown argument: %s", arg.c_str());
+        }
+    }
+    if (!tracePath.empty()) {
+        if (!trace::Enabled()) {
+            SDL_Log("built without SOFTRENDER_TRACE, trace will be empty");
+        }
+        trace::SetThreadName("main");
+        trace::Start();
+    }
+    int ret = 0;
+    if (!serverSocket.empty()) {
+#ifndef _WIN32
+        ret = RunServer(serverSocket, serverWorkers, loadOptions);
+#else
+        SDL_Log("render server is not supported on this platform");
+        ret = 1;
+#endif
+    } else if (batch.frames > 0) {
+        ret = RunBatch(batch, config, loadOptions, backend);
+    } else {
+        RedBirdApp app(config, loadOptions, heatmap, backend);
+        app.Run();
+    }
+    if (!tracePath.empty()) {
+        trace::Stop();
+        if (!trace::WriteChromeJson(tracePath)) {
+            SDL_Log("failed to write trace %s", tracePath.c_str());
+            ret = 1;
+        }
+    }
+    return ret;
+}
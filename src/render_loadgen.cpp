@@ -0,0 +1,139 @@
+// 本地渲染服务的压测客户端
+// 多个连接并发发送请求，统计端到端延迟的分位数和吞吐量
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "render_protocol.hpp"
+
+struct LoadConfig {
+    std::string socketPath = "/tmp/softrender.sock";
+    uint32_t clients = 4;
+    uint32_t requests = 100;
+    uint32_t model = 0;
+    uint32_t width = 512;
+    uint32_t height = 360;
+    ImageFormat format = ImageFormat::ARGB8888;
+};
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+    return sorted[index];
+}
+
+int main(int argv, char** args) {
+    LoadConfig config;
+    for (int i = 1; i < argv; i++) {
+        std::string arg = args[i];
+        bool hasValue = i + 1 < argv;
+        if (arg == "--socket" && hasValue) {
+            config.socketPath = args[++i];
+        } else if (arg == "--clients" && hasValue) {
+            config.clients = std::stoul(args[++i]);
+        } else if (arg == "--requests" && hasValue) {
+            config.requests = std::stoul(args[++i]);
+        } else if (arg == "--model" && hasValue) {
+            config.model = std::stoul(args[++i]);
+        } else if (arg == "--width" && hasValue) {
+            config.width = std::stoul(args[++i]);
+        } else if (arg == "--height" && hasValue) {
+            config.height = std::stoul(args[++i]);
+        } else if (arg == "--format" && hasValue) {
+            config.format = std::string(args[++i]) == "rgb"
+                                ? ImageFormat::RGB24
+                                : ImageFormat::ARGB8888;
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    std::mutex mutex;
+    std::vector<double> latencies;
+    std::vector<double> queueTimes;
+    std::vector<double> renderTimes;
+    uint32_t failures = 0;
+
+    auto start = Clock::now();
+    std::vector<std::thread> clients;
+    for (uint32_t c = 0; c < config.clients; c++) {
+        clients.emplace_back([&, c]() {
+            RenderClient client;
+            std::vector<double> local;
+            std::vector<double> localQueue;
+            std::vector<double> localRender;
+            uint32_t localFailures = 0;
+            if (!client.Connect(config.socketPath)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failures += config.requests;
+                return;
+            }
+            RenderRequest request;
+            request.model = config.model;
+            request.width = config.width;
+            request.height = config.height;
+            request.format = config.format;
+            request.cameraRotation[0] = 0.0174533f;
+            for (uint32_t i = 0; i < config.requests; i++) {
+                request.modelRotation =
+                    360.0f * (c * config.requests + i) /
+                    (config.clients * config.requests);
+                RenderResponse response;
+                const uint8_t* image;
+                auto t = Clock::now();
+                bool ok = client.Render(request, response, image);
+                std::chrono::duration<double, std::milli> elapse =
+                    Clock::now() - t;
+                if (!ok || response.status != RenderStatus::Ok ||
+                    response.imageSize != size_t(config.width) *
+                                              config.height *
+                                              BytesPerPixel(config.format)) {
+                    localFailures++;
+                    if (!ok) {
+                        break;
+                    }
+                    continue;
+                }
+                local.push_back(elapse.count());
+                localQueue.push_back(response.queueMs);
+                localRender.push_back(response.renderMs);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+            queueTimes.insert(queueTimes.end(), localQueue.begin(),
+                              localQueue.end());
+            renderTimes.insert(renderTimes.end(), localRender.begin(),
+                               localRender.end());
+            failures += localFailures;
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    std::chrono::duration<double> total = Clock::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(queueTimes.begin(), queueTimes.end());
+    std::sort(renderTimes.begin(), renderTimes.end());
+    printf("clients: %u, requests: %zu ok / %u failed, %.3f s, %.2f req/s\n",
+           config.clients, latencies.size(), failures, total.count(),
+           latencies.size() / total.count());
+    auto report = [](const char* name, const std::vector<double>& values) {
+        printf("%-8s p50 %8.3f ms  p90 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+               name, Percentile(values, 0.50), Percentile(values, 0.90),
+               Percentile(values, 0.99), values.empty() ? 0.0 : values.back());
+    };
+    report("latency", latencies);
+    report("queue", queueTimes);
+    report("render", renderTimes);
+    return failures == 0 ? 0 : 1;
+}